@@ -0,0 +1,158 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef ARENA_HPP
+#define ARENA_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+//
+//	Monotonic arena for scratch memory
+//
+//	Allocations are bump allocated out of large blocks and never freed
+//	one by one. release() drops everything in one go, release_to() drops
+//	everything allocated after a mark(). Blocks are sized so that loading
+//	many meshes back to back settles on a single block that is reused
+//	without going back to the heap.
+//
+//	It's a std::pmr::memory_resource, so containers use it through
+//	std::pmr::vector and friends. It is not thread safe, allocate up
+//	front and hand the memory to the workers.
+//
+//	Example use:
+//	Arena arena( 1 << 20 );
+//	std::pmr::vector<float> scratch( count, &arena );
+//	...
+//	arena.release(); // once nothing uses the memory anymore
+//
+//	A borrowed arena may still hold its owner's memory, take a mark and
+//	release back to it instead:
+//	const Arena::Mark start = arena.mark();
+//	...
+//	arena.release_to( start );
+//
+class Arena : public std::pmr::memory_resource {
+public:
+	struct Stats {
+		size_t allocations = 0;		// allocations since the arena was made, bumps included
+		size_t heap_blocks = 0;		// blocks taken from the heap since the arena was made
+		size_t bytes_in_use = 0;	// bytes handed out since the last release
+		size_t peak_bytes = 0;		// highest bytes_in_use since the last reset_peak()
+		size_t reserved_bytes = 0;	// bytes held in blocks right now
+		size_t blocks = 0;			// blocks held right now
+	};
+
+	// Where the next allocation would go, see release_to()
+	struct Mark {
+		size_t block = 0;
+		size_t used = 0;
+		size_t bytes_in_use = 0;
+	};
+
+	explicit Arena( size_t initial_block_size = size_t(1) << 20 )
+		: first_block_size( std::max<size_t>( initial_block_size, 4096 ) ), next_block_size( first_block_size ) {}
+
+	~Arena() override { for( Block &b : blocks ){ free_block(b); } }
+
+	Arena( const Arena& ) = delete;
+	Arena& operator=( const Arena& ) = delete;
+
+	// Frees everything that was allocated. A single block is kept for the next user,
+	// if it took several the next block is made big enough to hold all of them.
+	void release()
+	{
+		if( blocks.size() > 1 ){
+			size_t total = 0;
+			for( Block &b : blocks ){ total += b.size; free_block(b); }
+			blocks.clear();
+			next_block_size = total;
+		}
+		current = 0;
+		used = 0;
+		arena_stats.bytes_in_use = 0;
+		arena_stats.reserved_bytes = blocks.empty() ? 0 : blocks.front().size;
+		arena_stats.blocks = blocks.size();
+	}
+
+	Mark mark() const { return Mark{ current, used, arena_stats.bytes_in_use }; }
+
+	// Frees what was allocated after the mark, what came before stays. The blocks
+	// are kept, allocations fill them again in order before new ones are made.
+	void release_to( const Mark &m )
+	{
+		if( m.bytes_in_use == 0 ){ release(); return; }
+		current = m.block;
+		used = m.used;
+		arena_stats.bytes_in_use = m.bytes_in_use;
+	}
+
+	// Starts a new high water mark from what is in use right now, e.g. at the start of a load
+	void reset_peak(){ arena_stats.peak_bytes = arena_stats.bytes_in_use; }
+
+	const Stats& stats() const { return arena_stats; }
+
+protected:
+	void* do_allocate( size_t bytes, size_t alignment ) override
+	{
+		if( !blocks.empty() ){
+			if( void *p = bump( bytes, alignment ) ){ return p; }
+		}
+
+		// Blocks left over from a release_to() come first
+		while( current + 1 < blocks.size() ){
+			++current;
+			used = 0;
+			if( void *p = bump( bytes, alignment ) ){ return p; }
+		}
+
+		// Current block is full, start a new one
+		Block b;
+		b.size = std::max( next_block_size, bytes + alignment );
+		b.data = static_cast<char*>( ::operator new( b.size, std::align_val_t(block_alignment) ) );
+		blocks.push_back( b );
+		current = blocks.size() - 1;
+		used = 0;
+		next_block_size *= 2;
+		++arena_stats.heap_blocks;
+		arena_stats.reserved_bytes += b.size;
+		arena_stats.blocks = blocks.size();
+		return bump( bytes, alignment );
+	}
+
+	// Memory only comes back through release()
+	void do_deallocate( void*, size_t, size_t ) override {}
+
+	bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept override { return this == &other; }
+
+private:
+	static constexpr size_t block_alignment = 64;
+
+	struct Block { char *data; size_t size; };
+
+	std::vector<Block> blocks;
+	size_t current = 0;	// block we bump allocate from
+	size_t used = 0;	// bytes used in that block
+	size_t first_block_size;
+	size_t next_block_size;
+	Stats arena_stats;
+
+	void* bump( size_t bytes, size_t alignment )
+	{
+		Block &b = blocks[current];
+		const size_t start = (used + alignment - 1) & ~(alignment - 1);
+		if( start + bytes > b.size ){ return nullptr; }
+		const size_t consumed = start + bytes - used;
+		used = start + bytes;
+		++arena_stats.allocations;
+		arena_stats.bytes_in_use += consumed;
+		arena_stats.peak_bytes = std::max( arena_stats.peak_bytes, arena_stats.bytes_in_use );
+		return b.data + start;
+	}
+
+	static void free_block( Block &b ){ ::operator delete( b.data, std::align_val_t(block_alignment) ); b.data = nullptr; }
+};
+
+#endif
@@ -0,0 +1,57 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef HW2B_EXPRESSION_HPP
+#define HW2B_EXPRESSION_HPP
+
+#include <cstddef>
+#include <type_traits>
+
+//
+//	Expression templates for Matrix
+//
+//	projection * view * model, or a * s + b, doesn't compute anything by itself:
+//	it builds a small node that remembers its operands. The work happens when the
+//	node is assigned to a Matrix (or multiplied by a vector), in one loop over
+//	the result with no Matrix in between.
+//
+//	Element-wise nodes compute an entry from the same entry of their operands.
+//	Matrix products are evaluated whole, and a product times a vector goes right
+//	to left, so projection * view * model * v is three matrix-vector products.
+//
+//	Vectors (Vec.hpp) are small enough that their operators just compute, they
+//	only say they're a VectorExpression so Matrix * vector takes them.
+//
+//	Nodes keep plain Matrix lvalues by reference and everything else by value,
+//	so don't keep a node (auto) past the end of the statement, assign it:
+//	GLmatrix mvp = projection * view * model;
+//
+// Description: Nodes built by the operators, as opposed to Matrix itself.
+template<typename E>
+concept ExpressionNode = requires { requires std::remove_cvref_t<E>::kExpressionNode; };
+
+// Description: Anything with three entries e[0], e[1] and e[2] of ValueType.
+template<typename E>
+concept VectorExpression = requires { requires std::remove_cvref_t<E>::kVectorExpression; };
+
+// Description: Anything with Rows x Columns entries e(row, column) of ValueType,
+// and Evaluate(out) / Transform(vector, out) to write them all or multiply a column vector.
+template<typename E>
+concept MatrixExpression = requires { requires std::remove_cvref_t<E>::kMatrixExpression; };
+
+// Description: How a node keeps an operand that came in as E (a forwarding reference type).
+template<typename E>
+using ExpressionOperand = std::conditional_t<std::is_lvalue_reference_v<E> && !ExpressionNode<E>,
+											 const std::remove_cvref_t<E>&, std::remove_cvref_t<E>>;
+
+// Description: A scalar that reads the same at every entry, for matrix * scalar.
+template<typename T>
+struct ScalarOperand {
+	using ValueType = T;
+	static constexpr bool kExpressionNode = true;
+
+	T fValue;
+
+	constexpr T operator()(size_t, size_t) const { return fValue; }
+};
+
+#endif // HW2B_EXPRESSION_HPP
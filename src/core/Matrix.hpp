@@ -6,10 +6,23 @@
 #include "glad/glad.h"
 
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <optional>
+#include <type_traits>
+#include <utility>
 
+#include "Expression.hpp"
 #include "Vector3D.hpp"
 
+// SSE kernels for Matrix<float, 4>, everything else (and other CPUs) use the scalar loops.
+// Built with -mavx the same intrinsics come out as AVX (VEX) instructions.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define MATRIX_SSE 1
+	#include <immintrin.h>
+#endif
+
 //typedef GLfloat GLmatrix[16];
 // 0	1	2	3	// X
 // 4	5	6	7	// Y
@@ -18,6 +31,22 @@
 
 // Numbering starts from 0!
 
+// The scale, rotation and translation setters only record the change. The matrix
+// is composed from them (in closed form) the next time it's read, so any number
+// of setters costs one rebuild. Reading a matrix with pending changes writes it,
+// so read it once (or ApplyTransforms()) before sharing it between threads.
+// Only setters leave changes pending and copies are composed when they're made,
+// so a const Matrix never has any, which is what lets reads compose in place.
+
+template<typename A, typename B>
+struct MatrixProduct;
+
+template<typename E>
+inline constexpr bool kIsMatrixProduct = false;
+
+template<typename A, typename B>
+inline constexpr bool kIsMatrixProduct<MatrixProduct<A, B>> = true;
+
 template<typename T, size_t Dimensions>
 requires(Dimensions > 0)
 struct Matrix {
@@ -26,44 +55,82 @@ struct Matrix {
 	static constexpr size_t Columns = Dimensions;
 	static constexpr size_t Size = Rows * Columns;
 
+	// Matrix<float, 4> takes the SIMD kernels below, picked at compile time.
+	// They add up the products in the same order as the loops, so the results are the same.
+	static constexpr bool kSimd = std::is_same_v<T, float> && Dimensions == 4;
+
+	// Expression template traits, see Expression.hpp
+	using ValueType = T;
+	static constexpr bool kMatrixExpression = true;
+
 public:
-	Matrix()
+	constexpr Matrix()
 		:
 		fArray()
 	{
 		Reset();
 	}
 
-	void
-	ApplyTransforms()
+	// Description: Copies compose any pending transforms, see the top of the file.
+	constexpr Matrix(const Matrix& other)
+		:
+		fArray()
 	{
-		Identity();
+		*this = other;
+		resolveTransforms();
+	}
 
-		// Apply Scaling
-		doScaleX(fScaleX);
-		doScaleY(fScaleY);
-		doScaleZ(fScaleZ);
+	constexpr Matrix& operator=(const Matrix& other) = default;
 
-		// Apply Rotation
-		doRotateX(fRotationX);
-		doRotateY(fRotationY);
-		doRotateZ(fRotationZ);
+	// Description: Evaluates a matrix expression such as projection * view * model.
+	// The transforms (scale, rotation...) are left at their defaults.
+	template<typename E>
+	requires(MatrixExpression<E> && !std::is_same_v<E, Matrix>)
+	constexpr Matrix(const E& expression)
+		:
+		fArray()
+	{
+		Reset();
+		expression.Evaluate(fArray.data());
+	}
 
-		// Apply Translation
-		doTranslateX(fTranslateX);
-		doTranslateY(fTranslateY);
-		doTranslateZ(fTranslateZ);
+	// Description: Overwrites the entries with a matrix expression, like writing them one by one.
+	template<typename E>
+	requires(MatrixExpression<E> && !std::is_same_v<E, Matrix>)
+	constexpr Matrix&
+	operator=(const E& expression)
+	{
+		// Pending transforms are composed first, the expression may read this matrix.
+		resolveTransforms();
+
+		// A product may read this matrix after writing the first row, so it goes through a copy.
+		// Element-wise nodes only read each entry before writing it.
+		if constexpr (kIsMatrixProduct<E>) {
+			std::array<T, Size> evaluated;
+			expression.Evaluate(evaluated.data());
+			fArray = evaluated;
+		} else {
+			expression.Evaluate(fArray.data());
+		}
+		return *this;
+	}
+
+	// Description: Composes the pending transforms now instead of on the next read.
+	void
+	ApplyTransforms()
+	{
+		composeTransforms();
 	}
 
 	// Access like raw array
-	constexpr operator const T*() const { return fArray.data(); }
+	constexpr operator const T*() const { resolveTransforms(); return fArray.data(); }
 
 	// Unchecked Access
-	T& operator[](size_t index) { return fArray[index]; }
-	constexpr const T& operator[](size_t index) const { return fArray[index]; }
+	constexpr T& operator[](size_t index) { resolveTransforms(); return fArray[index]; }
+	constexpr const T& operator[](size_t index) const { resolveTransforms(); return fArray[index]; }
 
-	T& operator()(size_t row, size_t column) { return fArray[rowAndColToIndex(row, column)]; }
-	constexpr const T& operator()(size_t row, size_t column) const { return fArray[rowAndColToIndex(row, column)]; }
+	constexpr T& operator()(size_t row, size_t column) { resolveTransforms(); return fArray[rowAndColToIndex(row, column)]; }
+	constexpr const T& operator()(size_t row, size_t column) const { resolveTransforms(); return fArray[rowAndColToIndex(row, column)]; }
 
 	// Checked Access
 	constexpr std::optional<T &>
@@ -72,6 +139,7 @@ public:
 		if (row > Rows || column > Columns)
 			return {};
 
+		resolveTransforms();
 		return fArray[rowAndColToIndex(row, column)];
 	}
 
@@ -81,6 +149,7 @@ public:
 		if (index >= Size)
 			return {};
 
+		resolveTransforms();
 		return fArray[index];
 	}
 
@@ -91,6 +160,9 @@ public:
 		fArray.fill(0);
 		for (size_t index = 0; index < Size; index += (Dimensions + 1))
 			fArray[index] = 1;
+
+		// Overwrites whatever the pending transforms would have given
+		fDirty &= ~kTransformsDirty;
 	}
 
 
@@ -107,6 +179,10 @@ public:
 		fRotationY = 0.f;
 		fRotationZ = 0.f;
 
+		fCosines = {1, 1, 1};
+		fSines = {0, 0, 0};
+		fDirty = 0;
+
 		Identity();
 	}
 
@@ -118,14 +194,14 @@ public:
 		fScaleX += factor;
 		fScaleY += factor;
 		fScaleZ += factor;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	void
 	ScaleXBy(const T& factor)
 	{
 		fScaleX += factor;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	constexpr void
@@ -133,7 +209,7 @@ public:
 	requires(Dimensions >= 2)
 	{
 		fScaleY += factor;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	void
@@ -141,7 +217,7 @@ public:
 	requires(Dimensions >= 3)
 	{
 		fScaleZ += factor;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 
@@ -151,7 +227,7 @@ public:
 	requires(Dimensions >= 2)
 	{
 		fRotationX += radians;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty | kRotationXDirty;
 	}
 
 	void
@@ -159,7 +235,7 @@ public:
 	requires(Dimensions >= 2)
 	{
 		fRotationY += radians;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty | kRotationYDirty;
 	}
 
 	void
@@ -167,7 +243,7 @@ public:
 	requires(Dimensions >= 2)
 	{
 		fRotationZ += radians;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty | kRotationZDirty;
 	}
 
 	/** Translate */
@@ -177,7 +253,7 @@ public:
 		fTranslateX += offset;
 		fTranslateY += offset;
 		fTranslateZ += offset;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	void
@@ -185,7 +261,7 @@ public:
 	requires(Dimensions >= 3)
 	{
 		fTranslateX += offset;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	void
@@ -193,7 +269,7 @@ public:
 	requires(Dimensions >= 3)
 	{
 		fTranslateY += offset;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
 	}
 
 	void
@@ -201,7 +277,56 @@ public:
 	requires(Dimensions >= 3)
 	{
 		fTranslateZ += offset;
-		ApplyTransforms();
+		fDirty |= kTransformsDirty;
+	}
+
+
+	/** Several transforms at once, still one rebuild */
+	void
+	ScaleBy(const Vector3D<T>& factors)
+	requires(Dimensions >= 3)
+	{
+		fScaleX += factors.x();
+		fScaleY += factors.y();
+		fScaleZ += factors.z();
+		fDirty |= kTransformsDirty;
+	}
+
+	void
+	RotateBy(const Vector3D<T>& radians)
+	requires(Dimensions >= 3)
+	{
+		fRotationX += radians.x();
+		fRotationY += radians.y();
+		fRotationZ += radians.z();
+		fDirty |= kTransformsDirty | kRotationDirty;
+	}
+
+	void
+	TranslateBy(const Vector3D<T>& offsets)
+	requires(Dimensions >= 3)
+	{
+		fTranslateX += offsets.x();
+		fTranslateY += offsets.y();
+		fTranslateZ += offsets.z();
+		fDirty |= kTransformsDirty;
+	}
+
+	// Description: Replaces the transforms. A scale of 0 on an axis is skipped, like 1.
+	void
+	SetTransforms(const Vector3D<T>& scale, const Vector3D<T>& radians, const Vector3D<T>& offsets)
+	requires(Dimensions >= 3)
+	{
+		fScaleX = scale.x();
+		fScaleY = scale.y();
+		fScaleZ = scale.z();
+		fRotationX = radians.x();
+		fRotationY = radians.y();
+		fRotationZ = radians.z();
+		fTranslateX = offsets.x();
+		fTranslateY = offsets.y();
+		fTranslateZ = offsets.z();
+		fDirty |= kTransformsDirty | kRotationDirty;
 	}
 
 
@@ -210,37 +335,20 @@ public:
 	void
 	MultiplyBy(const std::array<T, Size>& other)
 	{
-		Matrix<T, Dimensions> matrixC;
-		for (size_t row = 0; row < Dimensions; row++) {
-			for (size_t column = 0; column < Dimensions; column++) {
-				matrixC(row, column) = 0;
-				for (size_t calcOffset = 0; calcOffset < Dimensions; calcOffset++) {
-					matrixC(row, column) += (this->operator()(row, calcOffset) *
-											 other[rowAndColToIndex(calcOffset, column)]);
-				}
-			}
-		}
-
-		fArray = matrixC.fArray;
+		resolveTransforms();
+		std::array<T, Size> product;
+		Multiply(fArray.data(), other.data(), product.data());
+		fArray = product;
 	}
 
 
+	// Description: other's pending setters are composed first, like every other read of it.
 	void
 	MultiplyBy(const Matrix& other)
 	requires(Rows == other.Columns)
 	{
-		Matrix<T, Dimensions> matrixC;
-		for (size_t row = 0; row < Dimensions; row++) {
-			for (size_t column = 0; column < Dimensions; column++) {
-				matrixC(row, column) = 0;
-				for (size_t calcOffset = 0; calcOffset < Dimensions; calcOffset++) {
-					matrixC(row, column) += (this->operator()(row, calcOffset) *
-											 other[rowAndColToIndex(calcOffset, column)]);
-				}
-			}
-		}
-
-		fArray = matrixC.fArray;
+		other.resolveTransforms();
+		MultiplyBy(other.fArray);
 	}
 
 
@@ -248,195 +356,240 @@ public:
 	operator*=(const Matrix& other)
 	requires(Columns == other.Rows)
 	{
-		Matrix<T, Dimensions> matrixC;
-		for (size_t row = 0; row < Dimensions; row++) {
-			for (size_t column = 0; column < Dimensions; column++) {
-				matrixC(row, column) = 0;
-				for (size_t calcOffset = 0; calcOffset < Dimensions; calcOffset++) {
-					matrixC(row, column) += (this->operator()(row, calcOffset) *
-											 other[rowAndColToIndex(calcOffset, column)]);
-				}
-			}
-		}
-
-		return std::move(matrixC);
-	}
-
-
-	// When dealing with a 4x4 matrix, we assume w is implicitly 1
-	// when multiplying against a 3-coordinate vector (x, y, z).
-	Matrix&
-	operator*=(const Vector3D<T>& other)
-	requires(Dimensions == 3 || Dimensions == 4)
-	{
-		fArray[0] *= other.dx;
-		fArray[1] *= other.dy;
-		fArray[2] *= other.dz;
-
-		fArray[Dimensions] *= other.dx;
-		fArray[Dimensions + 1] *= other.dy;
-		fArray[Dimensions + 2] *= other.dz;
-
-		fArray[(Dimensions * 2)] *= other.dx;
-		fArray[(Dimensions * 2) + 1] *= other.dy;
-		fArray[(Dimensions * 2) + 2] *= other.dz;
-
+		MultiplyBy(other);
 		return *this;
 	}
 
-private:
-	[[nodiscard]] size_t rowAndColToIndex(size_t row, size_t column) const { return (row * Columns) + column; }
 
+	// Description: Swaps rows and columns.
 	void
-	doScaleX(T factor)
+	TransposeSelf()
 	{
-		if (factor == 0)
+		resolveTransforms();
+		if constexpr (kSimd) {
+#if MATRIX_SSE
+			__m128 row0 = _mm_loadu_ps(&fArray[0]);
+			__m128 row1 = _mm_loadu_ps(&fArray[4]);
+			__m128 row2 = _mm_loadu_ps(&fArray[8]);
+			__m128 row3 = _mm_loadu_ps(&fArray[12]);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(&fArray[0], row0);
+			_mm_storeu_ps(&fArray[4], row1);
+			_mm_storeu_ps(&fArray[8], row2);
+			_mm_storeu_ps(&fArray[12], row3);
 			return;
+#endif
+		}
 
-		Matrix<T, Dimensions> scaleMatrix;
-
-		static const float kScaleX = 0;
-		scaleMatrix[kScaleX] = factor;
-
-		MultiplyBy(scaleMatrix);
+		for (size_t row = 0; row < Rows; row++) {
+			for (size_t column = row + 1; column < Columns; column++)
+				std::swap(fArray[rowAndColToIndex(row, column)], fArray[rowAndColToIndex(column, row)]);
+		}
 	}
 
-	void
-	doScaleY(T factor)
+	[[nodiscard]] Matrix
+	Transposed() const
 	{
-		if (factor == 0)
-			return;
-
-		Matrix<T, Dimensions> scaleMatrix;
-
-		static constexpr float kScaleY = Dimensions + 1;
-		scaleMatrix[kScaleY] = factor;
-
-		MultiplyBy(scaleMatrix);
+		Matrix transposed = *this;
+		transposed.TransposeSelf();
+		return transposed;
 	}
 
 
-
-	void
-	doScaleZ(T factor)
+	// Description: C = A * B for row-major arrays of Size entries. C may not alias A or B.
+	static constexpr void
+	Multiply(const T* matrixA, const T* matrixB, T* matrixC)
 	{
-		if (factor == 0)
-			return;
-
-		Matrix<T, Dimensions> scaleMatrix;
-
-		static constexpr float kScaleZ = (2 * Dimensions) + 2;
-		scaleMatrix[kScaleZ] = factor;
+		if constexpr (kSimd) {
+			if (!std::is_constant_evaluated()) {
+#if MATRIX_SSE
+				// Row r of C = sum over k of A(r, k) * row k of B
+				const __m128 rowB0 = _mm_loadu_ps(matrixB);
+				const __m128 rowB1 = _mm_loadu_ps(matrixB + 4);
+				const __m128 rowB2 = _mm_loadu_ps(matrixB + 8);
+				const __m128 rowB3 = _mm_loadu_ps(matrixB + 12);
+				for (size_t row = 0; row < 4; row++) {
+					const __m128 rowA = _mm_loadu_ps(matrixA + (row * 4));
+					__m128 rowC = _mm_mul_ps(_mm_shuffle_ps(rowA, rowA, _MM_SHUFFLE(0, 0, 0, 0)), rowB0);
+					rowC = _mm_add_ps(rowC, _mm_mul_ps(_mm_shuffle_ps(rowA, rowA, _MM_SHUFFLE(1, 1, 1, 1)), rowB1));
+					rowC = _mm_add_ps(rowC, _mm_mul_ps(_mm_shuffle_ps(rowA, rowA, _MM_SHUFFLE(2, 2, 2, 2)), rowB2));
+					rowC = _mm_add_ps(rowC, _mm_mul_ps(_mm_shuffle_ps(rowA, rowA, _MM_SHUFFLE(3, 3, 3, 3)), rowB3));
+					_mm_storeu_ps(matrixC + (row * 4), rowC);
+				}
+				return;
+#endif
+			}
+		}
 
-		MultiplyBy(scaleMatrix);
+		for (size_t row = 0; row < Dimensions; row++) {
+			for (size_t column = 0; column < Dimensions; column++) {
+				T sum = matrixA[row * Columns] * matrixB[column];
+				for (size_t calcOffset = 1; calcOffset < Dimensions; calcOffset++)
+					sum += matrixA[(row * Columns) + calcOffset] * matrixB[(calcOffset * Columns) + column];
+				matrixC[(row * Columns) + column] = sum;
+			}
+		}
 	}
 
-	void
-	doTranslateX(T offset)
+	// Description: out = M * v, v a column of Dimensions entries.
+	constexpr void
+	Transform(const T* vector, T* out) const
 	{
-		if (offset == 0)
-			return;
+		resolveTransforms();
+		if constexpr (kSimd) {
+			if (!std::is_constant_evaluated()) {
+#if MATRIX_SSE
+				_mm_storeu_ps(out, Transform(_mm_loadu_ps(vector)));
+				return;
+#endif
+			}
+		}
 
-		Matrix<T, Dimensions> translateMatrix;
+		for (size_t row = 0; row < Rows; row++) {
+			T sum = fArray[row * Columns] * vector[0];
+			for (size_t column = 1; column < Columns; column++)
+				sum += fArray[(row * Columns) + column] * vector[column];
+			out[row] = sum;
+		}
+	}
 
-		static const size_t kTranslateX = 12;
-		translateMatrix[kTranslateX] = offset;
 
-		MultiplyBy(translateMatrix);
+	// Description: Writes the entries to out, row by row.
+	constexpr void
+	Evaluate(T* out) const
+	{
+		resolveTransforms();
+		for (size_t index = 0; index < Size; index++)
+			out[index] = fArray[index];
 	}
 
 
-
-	void
-	doTranslateY(T offset)
+	// When dealing with a 4x4 matrix, we assume w is implicitly 1
+	// when multiplying against a 3-coordinate vector (x, y, z).
+	Matrix&
+	operator*=(const Vector3D<T>& other)
+	requires(Dimensions == 3 || Dimensions == 4)
 	{
-		if (offset == 0)
-			return;
+		resolveTransforms();
+		fArray[0] *= other.x();
+		fArray[1] *= other.y();
+		fArray[2] *= other.z();
 
-		Matrix<T, Dimensions> translateMatrix;
+		fArray[Dimensions] *= other.x();
+		fArray[Dimensions + 1] *= other.y();
+		fArray[Dimensions + 2] *= other.z();
 
-		static const size_t kTranslateY = 13;
-		translateMatrix[kTranslateY] = offset;
+		fArray[(Dimensions * 2)] *= other.x();
+		fArray[(Dimensions * 2) + 1] *= other.y();
+		fArray[(Dimensions * 2) + 2] *= other.z();
 
-		MultiplyBy(translateMatrix);
+		return *this;
 	}
 
-	void
-	doTranslateZ(T offset)
+#if MATRIX_SSE
+	// Description: M * v in a register, for Matrix<float, 4>.
+	[[nodiscard]] __m128
+	Transform(__m128 v) const
+	requires(kSimd)
 	{
-		if (offset == 0)
-			return;
+		resolveTransforms();
 
-		Matrix<T, Dimensions> translateMatrix;
-
-		static const size_t kTranslateZ = 14;
-		translateMatrix[kTranslateZ] = offset;
-
-		MultiplyBy(translateMatrix);
+		// The four row products, transposed so adding them up row by row gives the dot products
+		__m128 product0 = _mm_mul_ps(_mm_loadu_ps(&fArray[0]), v);
+		__m128 product1 = _mm_mul_ps(_mm_loadu_ps(&fArray[4]), v);
+		__m128 product2 = _mm_mul_ps(_mm_loadu_ps(&fArray[8]), v);
+		__m128 product3 = _mm_mul_ps(_mm_loadu_ps(&fArray[12]), v);
+		_MM_TRANSPOSE4_PS(product0, product1, product2, product3);
+		return _mm_add_ps(_mm_add_ps(_mm_add_ps(product0, product1), product2), product3);
 	}
+#endif
 
-	void
-	doRotateX(T radians)
-	{
-		if (radians == 0)
-			return;
-
-		double cosRads = std::cos(radians);
-		double sinRads = std::sin(radians);
+private:
+	[[nodiscard]] constexpr size_t rowAndColToIndex(size_t row, size_t column) const { return (row * Columns) + column; }
 
-		// Rotate around X-axis
-		std::array<T, Size> rotationArray = {
-				1,	0,			0,			0,
-				0,	cosRads,	sinRads,	0,
-				0,	-sinRads,	cosRads,	0,
-				0,	0,			0,			1
-		};
+	static constexpr uint8_t kTransformsDirty = 1 << 0;
+	static constexpr uint8_t kRotationXDirty = 1 << 1;
+	static constexpr uint8_t kRotationYDirty = 1 << 2;
+	static constexpr uint8_t kRotationZDirty = 1 << 3;
+	static constexpr uint8_t kRotationDirty = kRotationXDirty | kRotationYDirty | kRotationZDirty;
 
-		this->MultiplyBy(rotationArray);
+	constexpr void
+	resolveTransforms() const
+	{
+		// Never const when there's something to compose, see the top of the file
+		if (fDirty & kTransformsDirty)
+			const_cast<Matrix*>(this)->composeTransforms();
 	}
 
+	// Description: Builds Scale * RotateX * RotateY * RotateZ * Translate straight into the array.
+	// Gives what multiplying the nine matrices from the identity did, rounding included, as the
+	// entries they skip are exact zeros. A transform of 0 is skipped, so a scale of 0 acts as 1.
 	void
-	doRotateY(T radians)
+	composeTransforms()
 	{
-		if (radians == 0)
-			return;
+		// Only the angles that moved need their sine and cosine again
+		if (fDirty & kRotationXDirty) {
+			fCosines[0] = T(std::cos(fRotationX));
+			fSines[0] = T(std::sin(fRotationX));
+		}
+		if (fDirty & kRotationYDirty) {
+			fCosines[1] = T(std::cos(fRotationY));
+			fSines[1] = T(std::sin(fRotationY));
+		}
+		if (fDirty & kRotationZDirty) {
+			fCosines[2] = T(std::cos(fRotationZ));
+			fSines[2] = T(std::sin(fRotationZ));
+		}
+		fDirty = 0;
 
-		double cosRads = std::cos(radians);
-		double sinRads = std::sin(radians);
+		fArray.fill(0);
+		for (size_t index = 0; index < Size; index += (Dimensions + 1))
+			fArray[index] = 1;
 
-		// Rotate around Y-axis
-		std::array<T, Size> rotationArray = {
-				cosRads,	0,	-sinRads,	0,
-				0,			1,	0,				0,
-				sinRads,	0,	cosRads,		0,
-				0,			0,	0,				1
-		};
+		// Scaling sets the diagonal
+		if (fScaleX != 0)
+			fArray[0] = fScaleX;
+		if constexpr (Dimensions >= 2) {
+			if (fScaleY != 0)
+				fArray[Dimensions + 1] = fScaleY;
+		}
+		if constexpr (Dimensions >= 3) {
+			if (fScaleZ != 0)
+				fArray[(2 * Dimensions) + 2] = fScaleZ;
+
+			// Each rotation mixes two columns of the upper left 3x3
+			if (fRotationX != 0)
+				rotateColumns(1, 2, fCosines[0], -fSines[0]);
+			if (fRotationY != 0)
+				rotateColumns(0, 2, fCosines[1], fSines[1]);
+			if (fRotationZ != 0)
+				rotateColumns(0, 1, fCosines[2], fSines[2]);
+		}
 
-		this->MultiplyBy(rotationArray);
+		// The translations only fill in the bottom row
+		if constexpr (Dimensions >= 4) {
+			fArray[rowAndColToIndex(Rows - 1, 0)] = fTranslateX;
+			fArray[rowAndColToIndex(Rows - 1, 1)] = fTranslateY;
+			fArray[rowAndColToIndex(Rows - 1, 2)] = fTranslateZ;
+		}
 	}
 
+	// Description: Upper left 3x3 times a rotation that only mixes columns first and second,
+	// sinFirst being the rotation's entry at (second, first). Products are added as in Multiply().
 	void
-	doRotateZ(T radians)
+	rotateColumns(size_t first, size_t second, T cosine, T sinFirst)
 	{
-		if (radians == 0)
-			return;
-
-		double cosRads = std::cos(radians);
-		double sinRads = std::sin(radians);
-
-		// Rotate around Z-axis
-		std::array<T, Size> rotationArray = {
-			cosRads,	-sinRads,	0,	0,
-			sinRads,	cosRads,		0,	0,
-			0,			0,				1,	0,
-			0,			0,				0,	1
-		};
-
-		this->MultiplyBy(rotationArray);
+		for (size_t row = 0; row < 3; row++) {
+			T& entryFirst = fArray[rowAndColToIndex(row, first)];
+			T& entrySecond = fArray[rowAndColToIndex(row, second)];
+			const T mixedFirst = (entryFirst * cosine) + (entrySecond * sinFirst);
+			entrySecond = (entryFirst * -sinFirst) + (entrySecond * cosine);
+			entryFirst = mixedFirst;
+		}
 	}
 
 private:
-	// Underlying Array
+	// Underlying Array, composed on read when the transforms changed
 	std::array<T, Size> fArray;
 
 	float fScaleX = 1.f;
@@ -450,6 +603,11 @@ private:
 	float fRotationX = 0.f;
 	float fRotationY = 0.f;
 	float fRotationZ = 0.f;
+
+	// What changed since the last compose, and the rotations' cached sines and cosines
+	uint8_t fDirty = 0;
+	std::array<T, 3> fCosines = {1, 1, 1};
+	std::array<T, 3> fSines = {0, 0, 0};
 };
 
 /** Stream Operator */
@@ -468,35 +626,215 @@ operator<<(std::ostream& out, const Matrix<T, Dimensions>& matrix)
 	return out;
 }
 
-// This only works with matrices of the same size for now...
+/** Expressions */
+
+// Description: Element-wise node, entry (row, column) is Operation()(a(row, column), b(row, column)).
+template<typename Operation, typename A, typename B>
+struct MatrixNode;
+
+// Description: A Matrix under an element-wise node, composed once when the node is built.
 template<typename T, size_t Dimensions>
-static Matrix<T, Dimensions>
-operator*(const Matrix<T, Dimensions>& matrixA, const Matrix<T, Dimensions>& matrixB)
-{
-	Matrix<T, Dimensions> matrixC;
-	for (size_t row = 0; row < Dimensions; row++) {
-		for (size_t column = 0; column < Dimensions; column++) {
-			matrixC(row, column) = 0;
-			for (size_t calcOffset = 0; calcOffset < Dimensions; calcOffset++) {
-				matrixC(row, column) += (matrixA(row, calcOffset) * matrixB(calcOffset, column));
-			}
+struct MatrixEntries {
+	constexpr MatrixEntries(const Matrix<T, Dimensions>& matrix) : fEntries(matrix) {}
+
+	constexpr T operator()(size_t row, size_t column) const { return fEntries[(row * Dimensions) + column]; }
+
+	const T* fEntries;
+};
+
+// Description: A temporary Matrix or a product under an element-wise node, evaluated
+// once when the node is built rather than once per entry.
+template<typename T, size_t Dimensions>
+struct EvaluatedMatrix {
+	template<typename E>
+	constexpr EvaluatedMatrix(const E& expression) : fEntries() { expression.Evaluate(fEntries.data()); }
+
+	constexpr T operator()(size_t row, size_t column) const { return fEntries[(row * Dimensions) + column]; }
+
+	std::array<T, Dimensions * Dimensions> fEntries;
+};
+
+// Description: How an element-wise node keeps an operand that came in as E.
+template<typename E, typename Stored = std::remove_cvref_t<E>>
+struct MatrixOperandOf {
+	using Type = ExpressionOperand<E>;
+};
+
+template<typename E, typename T, size_t Dimensions>
+struct MatrixOperandOf<E, Matrix<T, Dimensions>> {
+	using Type = std::conditional_t<std::is_lvalue_reference_v<E>, MatrixEntries<T, Dimensions>, EvaluatedMatrix<T, Dimensions>>;
+};
+
+template<typename E, typename A, typename B>
+struct MatrixOperandOf<E, MatrixProduct<A, B>> {
+	using Type = EvaluatedMatrix<typename MatrixProduct<A, B>::ValueType, MatrixProduct<A, B>::Rows>;
+};
+
+template<typename E>
+using MatrixOperand = typename MatrixOperandOf<E>::Type;
+
+template<typename Operation, typename A, typename B>
+struct MatrixNode {
+	using ValueType = typename std::remove_cvref_t<A>::ValueType;
+	static constexpr size_t Rows = std::remove_cvref_t<A>::Rows;
+	static constexpr size_t Columns = std::remove_cvref_t<A>::Columns;
+	static constexpr bool kMatrixExpression = true;
+	static constexpr bool kExpressionNode = true;
+
+	MatrixOperand<A> fA;
+	MatrixOperand<B> fB;
+
+	constexpr ValueType operator()(size_t row, size_t column) const { return Operation()(fA(row, column), fB(row, column)); }
+
+	constexpr void
+	Evaluate(ValueType* out) const
+	{
+		for (size_t row = 0; row < Rows; row++) {
+			for (size_t column = 0; column < Columns; column++)
+				out[(row * Columns) + column] = (*this)(row, column);
 		}
 	}
 
-	return matrixC;
+	constexpr void
+	Transform(const ValueType* vector, ValueType* out) const
+	{
+		for (size_t row = 0; row < Rows; row++) {
+			ValueType sum = (*this)(row, 0) * vector[0];
+			for (size_t column = 1; column < Columns; column++)
+				sum += (*this)(row, column) * vector[column];
+			out[row] = sum;
+		}
+	}
+};
+
+// Description: Product node, evaluated whole when it's read.
+template<typename A, typename B>
+struct MatrixProduct {
+	using ValueType = typename std::remove_cvref_t<A>::ValueType;
+	static constexpr size_t Rows = std::remove_cvref_t<A>::Rows;
+	static constexpr size_t Columns = std::remove_cvref_t<A>::Columns;
+	static constexpr size_t Size = Rows * Columns;
+	static constexpr bool kMatrixExpression = true;
+	static constexpr bool kExpressionNode = true;
+
+	ExpressionOperand<A> fLeft;
+	ExpressionOperand<B> fRight;
+
+	constexpr void
+	Evaluate(ValueType* out) const
+	{
+		// Matrices are multiplied where they are, anything else is evaluated first
+		std::array<ValueType, Size> left, right;
+		Matrix<ValueType, Rows>::Multiply(entries(fLeft, left), entries(fRight, right), out);
+	}
+
+	// Description: (A * B) * v as A * (B * v), never building A * B.
+	constexpr void
+	Transform(const ValueType* vector, ValueType* out) const
+	{
+		std::array<ValueType, Rows> partial;
+		fRight.Transform(vector, partial.data());
+		fLeft.Transform(partial.data(), out);
+	}
+
+private:
+	template<typename E>
+	static constexpr const ValueType*
+	entries(const E& operand, std::array<ValueType, Size>& scratch)
+	{
+		if constexpr (ExpressionNode<E>) {
+			operand.Evaluate(scratch.data());
+			return scratch.data();
+		} else {
+			return operand;
+		}
+	}
+};
+
+template<typename A, typename B>
+requires(MatrixExpression<A> && MatrixExpression<B> && std::remove_cvref_t<A>::Rows == std::remove_cvref_t<B>::Rows)
+constexpr auto
+operator+(A&& matrixA, B&& matrixB)
+{
+	return MatrixNode<std::plus<>, A, B>{ std::forward<A>(matrixA), std::forward<B>(matrixB) };
 }
 
-template<typename T, size_t Dimensions>
-static Vector3D<T>
-operator*(const Matrix<T, Dimensions>& matrix, const Vector3D<T> vector)
-requires(Dimensions >= 3)
+template<typename A, typename B>
+requires(MatrixExpression<A> && MatrixExpression<B> && std::remove_cvref_t<A>::Rows == std::remove_cvref_t<B>::Rows)
+constexpr auto
+operator-(A&& matrixA, B&& matrixB)
+{
+	return MatrixNode<std::minus<>, A, B>{ std::forward<A>(matrixA), std::forward<B>(matrixB) };
+}
+
+template<typename M>
+requires(MatrixExpression<M>)
+constexpr auto
+operator*(M&& matrix, const typename std::remove_cvref_t<M>::ValueType& scalar)
 {
-	Vector3D<T> calculatedVector;
-	calculatedVector.dx = (matrix(0, 0) * vector.dx) + (matrix(0, 1) * vector.dy) + (matrix(0, 2) * vector.dz);
-	calculatedVector.dy = (matrix(1, 0) * vector.dx) + (matrix(1, 1) * vector.dy) + (matrix(1, 2) * vector.dz);
-	calculatedVector.dz = (matrix(2, 0) * vector.dx) + (matrix(2, 1) * vector.dy) + (matrix(2, 2) * vector.dz);
+	using Scalar = ScalarOperand<typename std::remove_cvref_t<M>::ValueType>;
+	return MatrixNode<std::multiplies<>, M, Scalar>{ std::forward<M>(matrix), Scalar{ scalar } };
+}
 
-	return calculatedVector;
+// This only works with matrices of the same size for now...
+template<typename A, typename B>
+requires(MatrixExpression<A> && MatrixExpression<B> && std::remove_cvref_t<A>::Rows == std::remove_cvref_t<B>::Rows)
+constexpr auto
+operator*(A&& matrixA, B&& matrixB)
+{
+	return MatrixProduct<A, B>{ std::forward<A>(matrixA), std::forward<B>(matrixB) };
+}
+
+// Only the upper left 3x3 applies, as if w were 0. Nine products are quicker
+// as they are than shuffled in and out of SSE registers, so there's no kernel.
+template<typename M, typename V>
+requires(MatrixExpression<M> && VectorExpression<V> && std::remove_cvref_t<M>::Rows >= 3)
+constexpr Vector3D<typename std::remove_cvref_t<M>::ValueType>
+operator*(const M& matrix, const V& vector)
+{
+	using T = typename std::remove_cvref_t<M>::ValueType;
+	if constexpr (!ExpressionNode<M>) {
+		// Composed once, then read straight from the array
+		const T* m = matrix;
+		const size_t row1 = M::Columns, row2 = 2 * M::Columns;
+		const Vector3D<T> v = vector;
+		Vector3D<T> calculatedVector;
+		calculatedVector.x() = (m[0] * v.x()) + (m[1] * v.y()) + (m[2] * v.z());
+		calculatedVector.y() = (m[row1] * v.x()) + (m[row1 + 1] * v.y()) + (m[row1 + 2] * v.z());
+		calculatedVector.z() = (m[row2] * v.x()) + (m[row2 + 1] * v.y()) + (m[row2 + 2] * v.z());
+
+		return calculatedVector;
+	} else {
+		// Through the chain right to left, w (and anything past it) 0
+		std::array<T, std::remove_cvref_t<M>::Rows> padded{}, calculated{};
+		padded[0] = vector[0];
+		padded[1] = vector[1];
+		padded[2] = vector[2];
+		matrix.Transform(padded.data(), calculated.data());
+
+		return Vector3D<T>(calculated[0], calculated[1], calculated[2]);
+	}
+}
+
+template<typename M>
+requires(MatrixExpression<M>)
+constexpr auto
+operator*(const M& matrix, const std::array<typename M::ValueType, M::Rows>& vector)
+{
+	std::array<typename M::ValueType, M::Rows> calculated{};
+	matrix.Transform(vector.data(), calculated.data());
+	return calculated;
+}
+
+// Homogeneous vectors, w included. Vec4fA keeps a mesh's points on 16 bytes for the SSE kernel.
+template<typename M, size_t Align>
+requires(MatrixExpression<M> && std::remove_cvref_t<M>::Rows == 4)
+constexpr Vec<4, typename std::remove_cvref_t<M>::ValueType, Align>
+operator*(const M& matrix, const Vec<4, typename std::remove_cvref_t<M>::ValueType, Align>& vector)
+{
+	Vec<4, typename std::remove_cvref_t<M>::ValueType, Align> calculated;
+	matrix.Transform(vector.data, calculated.data);
+	return calculated;
 }
 
 
@@ -0,0 +1,267 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef HW2B_VEC_HPP
+#define HW2B_VEC_HPP
+
+#include <cfloat>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <ostream>
+#include <type_traits>
+
+// rsqrt for normalize(), other CPUs divide by the length
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define VEC_SSE 1
+	#include <immintrin.h>
+#endif
+
+//
+//	Vectors for both the mesh code and the matrix code
+//
+//	Vec<3, float> is what TriMesh stores (12 bytes, so a Vertex stays 36) and
+//	what Matrix transforms as Vector3D (see Vector3D.hpp). Vec<4, T> is the
+//	homogeneous version. Alignment 16 gives the SIMD friendly variants,
+//	Vec3fA is padded to 16 bytes and Vec4fA lines up with an SSE register.
+//
+//	Everything is constexpr except normalize(), which uses the SSE reciprocal
+//	square root for floats when it's not evaluated at compile time.
+//
+template<size_t D, class T, size_t Align = alignof(T)>
+requires(D == 3 || D == 4)
+class alignas(Align) Vec {
+public:
+	// Expression template traits, see Expression.hpp. Matrix * Vec<3, T> reads these.
+	using ValueType = T;
+	static constexpr bool kVectorExpression = (D == 3);
+	static constexpr size_t Size = D;
+
+	// Constructors, zero by default
+	constexpr Vec() : data{} {}
+
+	constexpr Vec(T x_, T y_, T z_)
+	requires(D == 3)
+		: data{x_, y_, z_} {}
+
+	constexpr Vec(T x_, T y_, T z_, T w_)
+	requires(D == 4)
+		: data{x_, y_, z_, w_} {}
+
+	// Description: Homogeneous vector from a 3D one, w is 1 for points and 0 for directions.
+	template<size_t OtherAlign>
+	constexpr Vec(const Vec<3, T, OtherAlign>& v, T w_)
+	requires(D == 4)
+		: data{v[0], v[1], v[2], w_} {}
+
+	// Description: Same vector, other alignment.
+	template<size_t OtherAlign>
+	requires(OtherAlign != Align)
+	constexpr Vec(const Vec<D, T, OtherAlign>& v)
+		: data{}
+	{
+		for (size_t i = 0; i < D; ++i)
+			data[i] = v[i];
+	}
+
+	// Data
+	T data[D];
+
+	// Functions
+	constexpr T operator[](size_t i) const { return data[i]; }
+	constexpr T& operator[](size_t i) { return data[i]; }
+
+	constexpr T x() const { return data[0]; }
+	constexpr T y() const { return data[1]; }
+	constexpr T z() const { return data[2]; }
+	constexpr T w() const requires(D == 4) { return data[3]; }
+	constexpr T& x() { return data[0]; }
+	constexpr T& y() { return data[1]; }
+	constexpr T& z() { return data[2]; }
+	constexpr T& w() requires(D == 4) { return data[3]; }
+
+	constexpr Vec&
+	operator+=(const Vec& v)
+	{
+		data[0] += v[0];
+		data[1] += v[1];
+		data[2] += v[2];
+		if constexpr (D == 4)
+			data[3] += v[3];
+		return *this;
+	}
+
+	constexpr Vec&
+	operator-=(const Vec& v)
+	{
+		data[0] -= v[0];
+		data[1] -= v[1];
+		data[2] -= v[2];
+		if constexpr (D == 4)
+			data[3] -= v[3];
+		return *this;
+	}
+
+	constexpr Vec&
+	operator*=(const T& scalar)
+	{
+		data[0] *= scalar;
+		data[1] *= scalar;
+		data[2] *= scalar;
+		if constexpr (D == 4)
+			data[3] *= scalar;
+		return *this;
+	}
+
+	constexpr Vec&
+	operator/=(const T& scalar)
+	{
+		data[0] /= scalar;
+		data[1] /= scalar;
+		data[2] /= scalar;
+		if constexpr (D == 4)
+			data[3] /= scalar;
+		return *this;
+	}
+
+	constexpr bool operator==(const Vec& v) const = default;
+	constexpr auto operator<=>(const Vec& v) const = default;
+
+	constexpr T
+	dot(const Vec& v) const
+	{
+		T r = data[0] * v[0] + data[1] * v[1] + data[2] * v[2];
+		if constexpr (D == 4)
+			r += data[3] * v[3];
+		return r;
+	}
+
+	constexpr Vec
+	cross(const Vec& v) const
+	requires(D == 3)
+	{
+		return Vec(data[1] * v[2] - data[2] * v[1], data[2] * v[0] - data[0] * v[2], data[0] * v[1] - data[1] * v[0]);
+	}
+
+	// Description: Squared length, and length, both in T.
+	constexpr T len2() const { return dot(*this); }
+
+	constexpr T
+	len() const
+	{
+		if (std::is_constant_evaluated())
+			return T(constantSqrt(double(len2())));
+		return T(std::sqrt(len2()));
+	}
+
+	// Description: Makes this a unit vector, leaves a zero vector alone.
+	void
+	normalize()
+	{
+		const T lengthSquared = len2();
+		if (!(lengthSquared > T(0)))
+			return;
+
+		if constexpr (std::is_same_v<T, float>) {
+#if VEC_SSE
+			// Estimate plus one Newton-Raphson step, a few ulps off 1 / sqrt. Denormal
+			// or infinite squared lengths would break the estimate, they take the division.
+			if (lengthSquared >= FLT_MIN && lengthSquared <= FLT_MAX) {
+				const float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(lengthSquared)));
+				*this *= estimate * (1.5f - 0.5f * lengthSquared * estimate * estimate);
+				return;
+			}
+#endif
+		}
+
+		*this /= len();
+	}
+
+	[[nodiscard]] Vec
+	normalized() const
+	{
+		Vec unit = *this;
+		unit.normalize();
+		return unit;
+	}
+
+private:
+	// Description: Newton's method, for len() at compile time where std::sqrt isn't constexpr.
+	static constexpr double
+	constantSqrt(double value)
+	{
+		if (!(value > 0.0) || value > DBL_MAX)
+			return value > 0.0 ? value : 0.0;
+
+		double root = value > 1.0 ? value : 1.0;
+		for (double previous = 0.0; root != previous;) {
+			previous = root;
+			root = 0.5 * (root + value / root);
+		}
+		return root;
+	}
+};
+
+/** Extra Operators */
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator+(Vec<D, T, A> v1, const Vec<D, T, A>& v2)
+{
+	return v1 += v2;
+}
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator-(Vec<D, T, A> v1, const Vec<D, T, A>& v2)
+{
+	return v1 -= v2;
+}
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator-(Vec<D, T, A> v)
+{
+	return v *= T(-1);
+}
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator*(Vec<D, T, A> v, const std::type_identity_t<T>& scalar)
+{
+	return v *= scalar;
+}
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator*(const std::type_identity_t<T>& scalar, Vec<D, T, A> v)
+{
+	return v *= scalar;
+}
+
+template<size_t D, class T, size_t A>
+constexpr Vec<D, T, A>
+operator/(Vec<D, T, A> v, const std::type_identity_t<T>& scalar)
+{
+	return v /= scalar;
+}
+
+template<size_t D, class T, size_t A>
+static std::ostream&
+operator<<(std::ostream& out, const Vec<D, T, A>& v)
+{
+	out << '(' << v[0];
+	for (size_t i = 1; i < D; ++i)
+		out << ", " << v[i];
+	return out << ')';
+}
+
+/** Types */
+using Vec3f = Vec<3, float>;
+using Vec3i = Vec<3, int>;
+using Vec4f = Vec<4, float>;
+using Vec3fA = Vec<3, float, 16>;
+using Vec4fA = Vec<4, float, 16>;
+
+static_assert(sizeof(Vec3f) == 12 && sizeof(Vec3fA) == 16 && alignof(Vec4fA) == 16, "Vec layouts");
+
+#endif // HW2B_VEC_HPP
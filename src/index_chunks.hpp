@@ -0,0 +1,151 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef INDEX_CHUNKS_HPP
+#define INDEX_CHUNKS_HPP 1
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "trimesh.hpp"
+
+//
+//	16 bit index buffers for big meshes
+//
+//	The faces are cut, in order, into chunks that each use at most
+//	max_chunk_vertices distinct vertices. A chunk is drawn with
+//	glDrawElementsBaseVertex: its indices are 16 bit and relative to
+//	the chunk's base_vertex.
+//
+//	A mesh with at most max_chunk_vertices vertices is a single chunk
+//	over the vertex buffer as it is. Bigger meshes get a new vertex
+//	buffer made of every chunk's vertices back to back, so each chunk's
+//	vertices are contiguous. Vertices shared by two chunks are in it
+//	twice, only a few percent for a mesh in a cache friendly order.
+//	See vertex_source and gather_chunk_vertices().
+//
+//	Example use:
+//	IndexChunks chunks;
+//	build_index_chunks( mesh.arrays(), chunks );
+//	< upload the vertices, or gather_chunk_vertices() if chunks.vertex_source isn't empty >
+//	< upload chunks.indices as GL_UNSIGNED_SHORT >
+//	for( const IndexChunk &c : chunks.chunks ){
+//		glDrawElementsBaseVertex( GL_TRIANGLES, c.num_indices, GL_UNSIGNED_SHORT, (void*)(c.first_index * 2), c.base_vertex );
+//	}
+//
+struct IndexChunk {
+	uint32_t first_index = 0;	// into IndexChunks::indices
+	uint32_t num_indices = 0;
+	uint32_t base_vertex = 0;
+	uint32_t num_vertices = 0;	// distinct vertices the chunk uses
+};
+
+struct IndexChunks {
+	static constexpr uint32_t max_chunk_vertices = 65535;
+
+	std::vector<IndexChunk> chunks;
+	std::vector<uint16_t> indices;
+
+	// Mesh vertex behind every vertex the chunks use,
+	// empty if they use the mesh's vertices as they are
+	std::vector<uint32_t> vertex_source;
+};
+
+// Cuts the faces into chunks
+static inline void build_index_chunks( const MeshArrays &mesh, IndexChunks &out, uint32_t max_chunk_vertices = IndexChunks::max_chunk_vertices );
+
+// The vertices the chunks use, in the mesh's layout. Faces are left out.
+static inline void gather_chunk_vertices( const MeshArrays &mesh, const IndexChunks &chunks, TriMesh &out );
+
+
+//
+//	Implementation
+//
+
+static inline void build_index_chunks( const MeshArrays &mesh, IndexChunks &out, uint32_t max_chunk_vertices )
+{
+	out.chunks.clear();
+	out.indices.clear();
+	out.vertex_source.clear();
+	out.indices.reserve( mesh.num_faces * 3 );
+	max_chunk_vertices = std::min( max_chunk_vertices, IndexChunks::max_chunk_vertices );
+
+	// Small enough to index directly
+	if( mesh.num_vertices <= max_chunk_vertices ){
+		for( size_t f = 0; f < mesh.num_faces; ++f ){
+			for( int k = 0; k < 3; ++k ){ out.indices.push_back( uint16_t( mesh.faces[f][k] ) ); }
+		}
+		IndexChunk chunk;
+		chunk.num_indices = uint32_t(out.indices.size());
+		chunk.num_vertices = uint32_t(mesh.num_vertices);
+		if( chunk.num_indices > 0 ){ out.chunks.push_back( chunk ); }
+		return;
+	}
+
+	const uint32_t unused = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> local( mesh.num_vertices, unused ), used;
+	out.vertex_source.reserve( mesh.num_vertices );
+
+	// Closes the chunk of faces [begin,end), 'used' holds its vertices in first-use order
+	auto close_chunk = [&]( size_t begin, size_t end ){
+		if( begin == end ){ return; }
+		IndexChunk chunk;
+		chunk.first_index = uint32_t(out.indices.size());
+		chunk.num_indices = uint32_t((end - begin) * 3);
+		chunk.num_vertices = uint32_t(used.size());
+		chunk.base_vertex = uint32_t(out.vertex_source.size());
+		out.vertex_source.insert( out.vertex_source.end(), used.begin(), used.end() );
+		for( size_t f = begin; f < end; ++f ){
+			for( int k = 0; k < 3; ++k ){ out.indices.push_back( uint16_t( local[ mesh.faces[f][k] ] ) ); }
+		}
+		out.chunks.push_back( chunk );
+		for( uint32_t v : used ){ local[v] = unused; }
+		used.clear();
+	};
+
+	size_t begin = 0;
+	for( size_t f = 0; f < mesh.num_faces; ++f ){
+		const Vec3i &face = mesh.faces[f];
+		uint32_t fresh = 0;
+		for( int k = 0; k < 3; ++k ){
+			const bool repeated = (k > 0 && face[k] == face[0]) || (k > 1 && face[k] == face[1]);
+			if( local[ face[k] ] == unused && !repeated ){ ++fresh; }
+		}
+		if( used.size() + fresh > max_chunk_vertices ){
+			close_chunk( begin, f );
+			begin = f;
+		}
+		for( int k = 0; k < 3; ++k ){
+			uint32_t &id = local[ face[k] ];
+			if( id == unused ){ id = uint32_t(used.size()); used.push_back( uint32_t(face[k]) ); }
+		}
+	}
+	close_chunk( begin, mesh.num_faces );
+}
+
+static inline void gather_chunk_vertices( const MeshArrays &mesh, const IndexChunks &chunks, TriMesh &out )
+{
+	const size_t nv = mesh.num_vertices, total = chunks.vertex_source.size();
+	auto source = [&]( size_t i ){ return size_t( chunks.vertex_source[i] ); };
+	out = TriMesh();
+	out.constant_color = mesh.constant_color;
+	if( mesh.interleaved ){
+		out.packed.resize( total );
+		for( size_t i = 0; i < total; ++i ){ out.packed[i] = mesh.interleaved[ source(i) ]; }
+		out.packed_constant_color = mesh.num_colors == 0;
+		return;
+	}
+	out.vertices.resize( total );
+	for( size_t i = 0; i < total; ++i ){ out.vertices[i] = mesh.vertex( source(i) ); }
+	if( mesh.num_colors == nv ){
+		out.colors.resize( total );
+		for( size_t i = 0; i < total; ++i ){ out.colors[i] = mesh.color( source(i) ); }
+	}
+	if( mesh.num_normals == nv ){
+		out.normals.resize( total );
+		for( size_t i = 0; i < total; ++i ){ out.normals[i] = mesh.normal( source(i) ); }
+	}
+}
+
+#endif
@@ -0,0 +1,147 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef LOAD_REPORT_HPP
+#define LOAD_REPORT_HPP 1
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+//
+//	Timings and counters of one mesh load
+//	Filled in by TriMesh::load_obj, TriMesh::need_normals, optimize_mesh's
+//	callers, MeshStream and init_scene. Phases that didn't run stay at zero.
+//
+struct LoadReport {
+	std::string file;
+	std::string source;				// "obj", "stream" or "cache"
+	unsigned threads = 0;
+
+	// Wall time per phase, in milliseconds
+	double open_ms = 0.0;			// opening and mapping the file
+	double prescan_ms = 0.0;		// counting records and sizing the arrays
+	double parse_ms = 0.0;			// tokenizing v/vn/f records
+	double resolve_ms = 0.0;		// turning face corners into vertices (and welding)
+	double normals_ms = 0.0;		// need_normals
+	double optimize_ms = 0.0;		// optimize_mesh
+	double upload_ms = 0.0;			// buffer creation and upload in init_scene
+
+	size_t bytes_read = 0;
+	size_t heap_allocations = 0;	// blocks the arena took from the heap plus output arrays that had to grow
+	size_t scratch_peak_bytes = 0;	// high water mark of the loader's arena during this load
+	int64_t peak_rss_delta = 0;		// growth of the process' peak resident set, in bytes
+
+	size_t vertices = 0;
+	size_t faces = 0;
+
+	double total_ms() const { return open_ms + prescan_ms + parse_ms + resolve_ms + normals_ms + optimize_ms + upload_ms; }
+
+	// One line per phase, for the console
+	inline void print( std::ostream &out ) const;
+
+	// Single JSON object, for tracking loads across releases
+	inline void write_json( std::ostream &out ) const;
+};
+
+
+//
+//	Wall clock stopwatch, lap() returns the milliseconds since the last lap
+//
+class Stopwatch {
+public:
+	Stopwatch() : last( std::chrono::steady_clock::now() ) {}
+
+	double lap()
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		const double ms = std::chrono::duration<double, std::milli>( now - last ).count();
+		last = now;
+		return ms;
+	}
+
+private:
+	std::chrono::steady_clock::time_point last;
+};
+
+
+// Peak resident set size of the process so far, in bytes
+static inline int64_t peak_rss_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) ){ return 0; }
+	return int64_t(counters.PeakWorkingSetSize);
+#else
+	struct rusage usage;
+	if( getrusage( RUSAGE_SELF, &usage ) != 0 ){ return 0; }
+	#ifdef __APPLE__
+		return int64_t(usage.ru_maxrss);		// bytes on macOS
+	#else
+		return int64_t(usage.ru_maxrss) * 1024;	// kilobytes everywhere else
+	#endif
+#endif
+}
+
+
+//
+//	Implementation
+//
+
+void LoadReport::print( std::ostream &out ) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(2);
+	out << "Load report for " << file << " (" << source << ", " << threads << " threads)\n";
+	out << "  open:    " << open_ms << " ms\n";
+	out << "  prescan: " << prescan_ms << " ms\n";
+	out << "  parse:   " << parse_ms << " ms\n";
+	out << "  resolve: " << resolve_ms << " ms\n";
+	out << "  normals: " << normals_ms << " ms\n";
+	out << "  optimize: " << optimize_ms << " ms\n";
+	out << "  upload:  " << upload_ms << " ms\n";
+	out << "  total:   " << total_ms() << " ms";
+	if( parse_ms > 0.0 ){ out << " (" << double(bytes_read) / (1024.0 * 1024.0) / ((open_ms + prescan_ms + parse_ms) / 1000.0) << " MB/s to parse)"; }
+	out << "\n  " << bytes_read << " bytes read, " << heap_allocations << " heap allocations, "
+		<< scratch_peak_bytes << " bytes scratch peak, " << peak_rss_delta << " bytes peak RSS growth\n";
+	out.flags( flags );
+	out.precision( precision );
+}
+
+void LoadReport::write_json( std::ostream &out ) const
+{
+	// File names are the only strings, escape what JSON can't hold
+	std::string escaped;
+	for( char c : file ){
+		if( c == '"' || c == '\\' ){ escaped += '\\'; escaped += c; }
+		else if( static_cast<unsigned char>(c) < 0x20 ){ escaped += ' '; }
+		else { escaped += c; }
+	}
+
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(3);
+	out << "{\"file\":\"" << escaped << "\",\"source\":\"" << source << "\",\"threads\":" << threads
+		<< ",\"open_ms\":" << open_ms << ",\"prescan_ms\":" << prescan_ms << ",\"parse_ms\":" << parse_ms
+		<< ",\"resolve_ms\":" << resolve_ms << ",\"normals_ms\":" << normals_ms << ",\"optimize_ms\":" << optimize_ms << ",\"upload_ms\":" << upload_ms
+		<< ",\"total_ms\":" << total_ms() << ",\"bytes_read\":" << bytes_read << ",\"heap_allocations\":" << heap_allocations
+		<< ",\"scratch_peak_bytes\":" << scratch_peak_bytes << ",\"peak_rss_delta\":" << peak_rss_delta
+		<< ",\"vertices\":" << vertices << ",\"faces\":" << faces << "}";
+	out.flags( flags );
+	out.precision( precision );
+}
+
+#endif
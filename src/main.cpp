@@ -7,10 +7,20 @@
 
 // Includes
 #include "trimesh.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_codec.hpp"
+#include "mesh_stream.hpp"
+#include "mesh_pages.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_quantize.hpp"
+#include "index_chunks.hpp"
+#include "mesh_lod.hpp"
 #include "shader.hpp"
 
 #include "core/Matrix.hpp"
 
+#include <unordered_map>
+
 // Constants
 const int WIN_WIDTH = 500;
 const int WIN_HEIGHT = 500;
@@ -28,10 +38,49 @@ const float kInitialViewBottom = -1;
 const float kInitialViewNear = 1.0;
 const float kInitialViewFar = 50.0;
 
+// Reuse a binary copy of the mesh next to the OBJ instead of parsing it every launch
+const bool kUseMeshCache = true;
+
+// Keep the cache compressed (<file>.meshz, 16 bit positions, entropy coded) instead of raw.
+// A fraction of the size on disk, but it's decoded into a TriMesh instead of mapped.
+const bool kCompressMeshCache = false;
+
+// Open the window right away and draw the mesh while it's still loading
+const bool kStreamMesh = true;
+
+// Cut the mesh into spatial pages on disk and only keep the ones near the camera in memory.
+// Meant for scans that don't fit in memory, so it's off for sibenik.
+const bool kOutOfCore = false;
+
+// Keep position, color and normal of a vertex together in one buffer instead of three.
+// Off uploads the split arrays, for comparison.
+const bool kInterleavedVertices = true;
+
+// Upload 16 byte quantized vertices (16 bit positions, octahedral normals, RGBA8 colors)
+// instead of floats, shader.vert dequantizes them. 12 bytes when the mesh has one color. A streamed mesh is quantized once it's complete.
+const bool kQuantizeVertices = true;
+
+// Draw big meshes in chunks of at most 65535 vertices with 16 bit indices and a base vertex
+const bool kShortIndices = true;
+
+// Simplify every index chunk into coarser levels and draw the coarsest one whose error
+// stays under kLodPixelError pixels on screen (needs kShortIndices)
+const bool kMeshLods = true;
+const float kLodPixelError = 1.f;
+
+// Reorder the loaded mesh for the vertex cache, overdraw and vertex fetch (the cache keeps the result)
+const bool kOptimizeMesh = true;
+
+// Also write the load timings as JSON next to the OBJ (<file>.loadreport.json)
+const bool kWriteLoadReport = false;
+
 // Scale change factors
 const float kTranslateFactor = 0.2f;
 const float kRotateFactor = std::numbers::pi_v<float> / 110.f;
 
+// glad was generated for OpenGL 3.1, glDrawElementsBaseVertex (3.2) is loaded by hand
+typedef void (APIENTRYP PFNGLDRAWELEMENTSBASEVERTEXPROC)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint basevertex);
+
 //
 //	Global state variables
 //
@@ -40,7 +89,36 @@ namespace Globals {
 	float win_height = WIN_HEIGHT; // window size
 	float aspect = win_width / win_height;
 	GLuint verts_vbo[1], colors_vbo[1], normals_vbo[1], faces_ibo[1], tris_vao;
+	GLuint vertex_vbo[1]; // interleaved or quantized layout
+	Vec3f positionOffset(0.f, 0.f, 0.f), positionScale(1.f, 1.f, 1.f); // dequantization, identity for floats
+	bool octahedralNormals = false;
+
+	// 16 bit index chunks, empty when drawing with 32 bit indices
+	IndexChunks indexChunks;
+	std::vector<ChunkLods> chunkLods; // one per chunk once lodBuilder is done, when kMeshLods
+	ChunkLodBuilder lodBuilder;
+	PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex = nullptr;
+	GLsizei num_indices = 0;
 	TriMesh mesh;
+	MeshCache meshCache;
+
+	// Progressive loading state
+	MeshStream meshStream;
+	bool streaming = false;
+	bool streamBuffersSized = false;
+	size_t streamedVertices = 0;
+	size_t streamedTriangles = 0;
+	double streamUploadMs = 0.0;
+
+	// Out-of-core state, GPU buffers of the resident pages
+	struct PageBuffers {
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		GLuint ibo = 0;
+		GLsizei num_indices = 0;
+	};
+	MeshPager meshPager;
+	std::unordered_map<uint32_t, PageBuffers> residentPages;
 
 	//  Model, view and projection matrices, initialized to the identity
 	GLmatrix gModelMatrix;
@@ -64,13 +142,25 @@ namespace Globals {
 //
 // Function to set up geometry & matrices
 //
-void init_scene();
+void init_scene(const MeshArrays& arrays);
+void upload_mesh(const MeshArrays& arrays);
+void upload_quantized_vertices(const MeshArrays& arrays);
+void draw_mesh();
 
 void calculate_viewing_matrix();
 void calculate_projection_matrix();
 
 void calculate_viewing_matrix_for_eye_change();
 
+void update_mesh_stream();
+void update_mesh_lods();
+
+void finish_load_report(LoadReport& report);
+
+bool open_mesh_pages(const std::string& objFile, const ObjLoadOptions& loadOptions, bool cacheHit);
+void update_mesh_pages();
+void draw_mesh_pages();
+
 
 //
 //	Callbacks
@@ -121,9 +211,9 @@ key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 			// Translate camera horizontally to the left using the -u direction
 			case GLFW_KEY_A:
 			{
-				Vector3Df n = Globals::gViewDir.Normalize() * -1.f;
-				Vector3Df u = Globals::gUpDir.CrossProduct(n);
-				u.NormalizeSelf();
+				Vector3Df n = Globals::gViewDir.normalized() * -1.f;
+				Vector3Df u = Globals::gUpDir.cross(n);
+				u.normalize();
 
 				Globals::gEyePos += u * kTranslateFactor;
 				calculate_viewing_matrix_for_eye_change();
@@ -134,9 +224,9 @@ key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 			// Translate camera horizontally to the right using the u direction
 			case GLFW_KEY_D:
 			{
-				Vector3Df n = Globals::gViewDir.Normalize() * -1.f;
-				Vector3Df u = Globals::gUpDir.CrossProduct(n);
-				u.NormalizeSelf();
+				Vector3Df n = Globals::gViewDir.normalized() * -1.f;
+				Vector3Df u = Globals::gUpDir.cross(n);
+				u.normalize();
 
 				Globals::gEyePos -= u * kTranslateFactor;
 				calculate_viewing_matrix_for_eye_change();
@@ -228,10 +318,54 @@ main(int argc, char* argv[])
 	// Load the mesh
 	std::stringstream obj_file;
 	obj_file << MY_DATA_DIR << "sibenik/sibenik.obj";
-	if (!Globals::mesh.load_obj(obj_file.str()))
-		return 0;
+	ObjLoadOptions loadOptions;
+	loadOptions.threads = 0; // Parse on every core
+	loadOptions.weld_vertices = true; // Share vertices between faces
+	loadOptions.interleave = kInterleavedVertices;
+	loadOptions.optimize = kOptimizeMesh;
+
+	// The cache is mapped and uploaded as-is, there's no TriMesh to fill
+	Stopwatch cacheTimer;
+	bool cacheHit = kUseMeshCache && !kCompressMeshCache && Globals::meshCache.open(obj_file.str(), loadOptions);
+	if (cacheHit) {
+		LoadReport& report = Globals::mesh.report;
+		report.file = obj_file.str();
+		report.source = "cache";
+		report.open_ms = cacheTimer.lap();
+		report.bytes_read = Globals::meshCache.mapped_size();
+		report.vertices = Globals::meshCache.arrays().num_vertices;
+		report.faces = Globals::meshCache.arrays().num_faces;
+	}
+	const bool decoded = kUseMeshCache && kCompressMeshCache && !kOutOfCore && read_compressed_mesh(obj_file.str(), loadOptions, Globals::mesh);
+	Globals::streaming = !kOutOfCore && !cacheHit && !decoded && kStreamMesh;
+	if (kOutOfCore) {
+		if (!open_mesh_pages(obj_file.str(), loadOptions, cacheHit))
+			return 0;
+	} else if (Globals::streaming) {
+		// The render loop picks the geometry up as it arrives
+		if (!Globals::meshStream.start(obj_file.str(), loadOptions, kUseMeshCache && !kCompressMeshCache))
+			return 0;
+	} else if (decoded) {
+		Globals::mesh.print_details();
+	} else if (!cacheHit) {
+		if (!Globals::mesh.load_obj(obj_file.str(), loadOptions))
+			return 0;
+
+		if (loadOptions.optimize) {
+			const MeshOptimizeStats stats = optimize_mesh(Globals::mesh);
+			stats.print(std::cout);
+			Globals::mesh.report.optimize_ms = stats.ms;
+		}
+
+		Globals::mesh.print_details();
+
+		if (kUseMeshCache && kCompressMeshCache) {
+			if (!write_compressed_mesh(obj_file.str(), loadOptions, Globals::mesh.arrays()))
+				std::cerr << "Could not write compressed mesh " << compressed_mesh_path(obj_file.str()) << '\n';
+		} else if (kUseMeshCache && !MeshCache::write(obj_file.str(), loadOptions, Globals::mesh.arrays()))
+			std::cerr << "Could not write mesh cache " << MeshCache::path_for(obj_file.str()) << '\n';
+	}
 
-	Globals::mesh.print_details();
 	// FYI: the model dimensions are: center = (0,0,0); height: 30.6; length: 40.3; width: 17.0
 
 	// Setup initial viewing transformation matrix
@@ -274,6 +408,7 @@ main(int argc, char* argv[])
 		glfwTerminate();
 		return EXIT_FAILURE;
 	}
+	Globals::drawElementsBaseVertex = reinterpret_cast<PFNGLDRAWELEMENTSBASEVERTEXPROC>(glfwGetProcAddress("glDrawElementsBaseVertex"));
 
 	// Initialize the shaders
 	// MY_SRC_DIR was defined in CMakeLists.txt
@@ -284,7 +419,19 @@ main(int argc, char* argv[])
 	shader.init_from_files(ss.str() + "vert", ss.str() + "frag");
 
 	// Initialize the scene
-	init_scene();
+	// (when streaming, this only creates the buffers, they are filled in the game loop,
+	// and out of core the pages bring their own buffers)
+	Stopwatch uploadTimer;
+	init_scene(kOutOfCore || Globals::streaming ? MeshArrays() : cacheHit ? Globals::meshCache.arrays() : Globals::mesh.arrays());
+	if (Globals::streaming)
+		Globals::streamUploadMs += uploadTimer.lap();
+	else if (!kOutOfCore) {
+		Globals::mesh.report.upload_ms = uploadTimer.lap();
+		finish_load_report(Globals::mesh.report);
+	}
+
+	// Everything is on the GPU now, the mapping can go
+	Globals::meshCache.close();
 	framebuffer_size_callback(window, int(Globals::win_width), int(Globals::win_height)); 
 
 	// Perform some OpenGL initializations
@@ -300,6 +447,18 @@ main(int argc, char* argv[])
     
 	// Game loop
 	while (!glfwWindowShouldClose(window)) {
+		// Upload whatever geometry the loader finished since the last frame
+		if (Globals::streaming)
+			update_mesh_stream();
+
+		// Swap pages in and out around the camera
+		if (kOutOfCore)
+			update_mesh_pages();
+
+		// Draw coarser levels once the worker has built them
+		if (kMeshLods)
+			update_mesh_lods();
+
 		// Clear the color and depth buffers
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -308,8 +467,17 @@ main(int argc, char* argv[])
 		glUniformMatrix4fv(shader.uniform("view"), 1, GL_FALSE, Globals::gViewMatrix); // viewing transformation
 		glUniformMatrix4fv(shader.uniform("projection"), 1, GL_FALSE, Globals::gProjectionMatrix); // projection matrix
 
+		// Vertex dequantization. Pages are float vertices with plain normals, only the whole mesh is quantized
+		const Vec3f identityOffset(0.f, 0.f, 0.f), identityScale(1.f, 1.f, 1.f);
+		glUniform3fv(shader.uniform("position_offset"), 1, kOutOfCore ? identityOffset.data : Globals::positionOffset.data);
+		glUniform3fv(shader.uniform("position_scale"), 1, kOutOfCore ? identityScale.data : Globals::positionScale.data);
+		glUniform1i(shader.uniform("octahedral_normals"), kOutOfCore ? GL_FALSE : Globals::octahedralNormals);
+
 		// Draw
-		glDrawElements(GL_TRIANGLES, Globals::mesh.faces.size() * 3, GL_UNSIGNED_INT, nullptr);
+		if (kOutOfCore)
+			draw_mesh_pages();
+		else
+			draw_mesh();
 
 		// Finalize
 		glfwSwapBuffers(window);
@@ -328,90 +496,472 @@ main(int argc, char* argv[])
 
 
 void
-init_scene()
+init_scene(const MeshArrays& arrays)
 {
 	using namespace Globals;
 
-	// Create the buffer for vertices
-	glGenBuffers(1, verts_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(mesh.vertices[0]), &mesh.vertices[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Create the buffer for colors
-	glGenBuffers(1, colors_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, mesh.colors.size() * sizeof(mesh.colors[0]), &mesh.colors[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Create the buffer for normals
-	glGenBuffers(1, normals_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(mesh.normals[0]), &mesh.normals[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// Create the buffers for the vertices, one interleaved buffer or one per attribute
+	if (kInterleavedVertices) {
+		glGenBuffers(1, vertex_vbo);
+	} else {
+		glGenBuffers(1, verts_vbo);
+		glGenBuffers(1, colors_vbo);
+		glGenBuffers(1, normals_vbo);
+	}
 
 	// Create the buffer for indices
 	glGenBuffers(1, faces_ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ibo[0]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.faces.size() * sizeof(mesh.faces[0]), &mesh.faces[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	// Create the VAO
+	// Create the VAO, the element buffer is part of it
 	glGenVertexArrays(1, &tris_vao);
 	glBindVertexArray(tris_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ibo[0]);
 
 	int vert_dim = 3;
+	if (kInterleavedVertices) {
+		// Every attribute reads from the same buffer
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
 
-	// location=0 is the vertex
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
-	glVertexAttribPointer(0, vert_dim, GL_FLOAT, GL_FALSE, sizeof(mesh.vertices[0]), nullptr);
+		// location=0 is the vertex
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
 
-	// location=1 is the color
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
-	glVertexAttribPointer(1, vert_dim, GL_FLOAT, GL_FALSE, sizeof(mesh.colors[0]), nullptr);
+		// location=1 is the color
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, color)));
 
-	// location=2 is the normal
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
-	glVertexAttribPointer(2, vert_dim, GL_FLOAT, GL_FALSE, sizeof(mesh.normals[0]), nullptr);
+		// location=2 is the normal
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
+	} else {
+		// location=0 is the vertex
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
+		glVertexAttribPointer(0, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), nullptr);
+
+		// location=1 is the color
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
+		glVertexAttribPointer(1, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), nullptr);
+
+		// location=2 is the normal
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
+		glVertexAttribPointer(2, vert_dim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), nullptr);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	// Done setting data for the vao
 	glBindVertexArray(0);
+
+	// A streamed mesh is filled in by the game loop instead
+	if (arrays.num_faces > 0)
+		upload_mesh(arrays);
+}
+
+void
+upload_mesh(const MeshArrays& arrays)
+{
+	using namespace Globals;
+
+	// Replaces whatever the buffers held before
+	glBindVertexArray(tris_vao);
+
+	// Indices, in 16 bit chunks if the driver can draw them with a base vertex
+	MeshArrays vertexArrays = arrays;
+	TriMesh withChunkVertices;
+	indexChunks = IndexChunks();
+	chunkLods.clear();
+	lodBuilder.cancel();
+	if (kShortIndices && drawElementsBaseVertex != nullptr) {
+		build_index_chunks(arrays, indexChunks);
+		if (!indexChunks.vertex_source.empty()) {
+			gather_chunk_vertices(arrays, indexChunks, withChunkVertices);
+			vertexArrays = withChunkVertices.arrays();
+		}
+		// The full chunks are drawn until the levels are ready, see update_mesh_lods
+		if (kMeshLods)
+			lodBuilder.start(vertexArrays, indexChunks);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexChunks.indices.size() * sizeof(uint16_t), indexChunks.indices.data(), GL_STATIC_DRAW);
+		std::cout << "Drawing " << arrays.num_faces << " triangles in " << indexChunks.chunks.size() << " 16 bit index chunks ("
+			<< (indexChunks.vertex_source.empty() ? arrays.num_vertices : indexChunks.vertex_source.size()) << " vertices)" << std::endl;
+	} else {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, arrays.num_faces * sizeof(Vec3i), arrays.faces, GL_STATIC_DRAW);
+	}
+	num_indices = GLsizei(arrays.num_faces * 3);
+
+	const size_t numVertices = vertexArrays.num_vertices;
+	if (kQuantizeVertices) {
+		upload_quantized_vertices(vertexArrays);
+	} else if (kInterleavedVertices && vertexArrays.num_colors == 0) {
+		// One color for every vertex, leave it out of the buffer
+		std::vector<UncoloredVertex> packed;
+		interleave_arrays(vertexArrays, 0, numVertices, packed);
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(UncoloredVertex), packed.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(UncoloredVertex), reinterpret_cast<void*>(offsetof(UncoloredVertex, position)));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(UncoloredVertex), reinterpret_cast<void*>(offsetof(UncoloredVertex, normal)));
+	} else if (kInterleavedVertices) {
+		// Streamed meshes and old split caches come in split, interleave them here
+		std::vector<Vertex> packed;
+		const Vertex* vertices = vertexArrays.interleaved;
+		if (vertices == nullptr) {
+			interleave_arrays(vertexArrays, 0, numVertices, packed);
+			vertices = packed.data();
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, color)));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vec3f), vertexArrays.vertices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertexArrays.num_colors * sizeof(Vec3f), vertexArrays.colors, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertexArrays.num_normals * sizeof(Vec3f), vertexArrays.normals, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// One color for every vertex, whatever the layout. A disabled array reads the current attribute value instead
+	if (vertexArrays.num_colors == 0) {
+		glDisableVertexAttribArray(1);
+		glVertexAttrib3f(1, vertexArrays.constant_color[0], vertexArrays.constant_color[1], vertexArrays.constant_color[2]);
+	} else {
+		glEnableVertexAttribArray(1);
+	}
+}
+
+void
+draw_mesh()
+{
+	using namespace Globals;
+
+	if (indexChunks.chunks.empty()) {
+		glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, nullptr);
+		return;
+	}
+
+	// The model matrix is the identity, so the eye is in the mesh's space
+	const Vec3f eye = gEyePos;
+	for (size_t c = 0; c < indexChunks.chunks.size(); ++c) {
+		const IndexChunk& chunk = indexChunks.chunks[c];
+		GLsizei count = GLsizei(chunk.num_indices);
+		size_t first = chunk.first_index;
+		if (!chunkLods.empty()) {
+			const ChunkLods& lods = chunkLods[c];
+			const LodLevel& level = lods.levels[select_lod(lods, eye, gProjectionMatrix[5], win_height, kLodPixelError)];
+			count = GLsizei(level.num_indices);
+			first = level.first_index;
+		}
+		drawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_SHORT,
+			reinterpret_cast<void*>(first * sizeof(uint16_t)), GLint(chunk.base_vertex));
+	}
+}
+
+void
+update_mesh_lods()
+{
+	using namespace Globals;
+
+	if (!lodBuilder.take(chunkLods, indexChunks.indices))
+		return;
+
+	// The levels come after the full chunks, so what's drawn now stays where it is
+	glBindVertexArray(tris_vao);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexChunks.indices.size() * sizeof(uint16_t), indexChunks.indices.data(), GL_STATIC_DRAW);
+	std::cout << "Built " << lodBuilder.num_levels() << " levels of detail in " << lodBuilder.ms() << " ms" << std::endl;
 }
 
+void
+upload_quantized_vertices(const MeshArrays& arrays)
+{
+	using namespace Globals;
+
+	// One color for every vertex is left out, upload_mesh sets it as a constant attribute
+	const bool colored = arrays.num_colors > 0;
+	QuantizedVertices quantized;
+	QuantizedUncoloredVertices uncolored;
+	if (colored) {
+		quantize_vertices(arrays, quantized);
+		positionOffset = quantized.offset;
+		positionScale = quantized.scale;
+	} else {
+		quantize_vertices(arrays, uncolored);
+		positionOffset = uncolored.offset;
+		positionScale = uncolored.scale;
+	}
+	octahedralNormals = true;
+
+	// The float buffers of the split layout aren't needed anymore
+	if (verts_vbo[0] != 0) {
+		glDeleteBuffers(1, verts_vbo);
+		glDeleteBuffers(1, colors_vbo);
+		glDeleteBuffers(1, normals_vbo);
+		verts_vbo[0] = colors_vbo[0] = normals_vbo[0] = 0;
+	}
+
+	// Replaces whatever the buffer held before
+	if (vertex_vbo[0] == 0)
+		glGenBuffers(1, vertex_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
+	if (colored)
+		glBufferData(GL_ARRAY_BUFFER, quantized.vertices.size() * sizeof(QuantizedVertex), quantized.vertices.data(), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, uncolored.vertices.size() * sizeof(QuantizedUncoloredVertex), uncolored.vertices.data(), GL_STATIC_DRAW);
+
+	// Normalized integers, the shader gets [0,1] positions, [0,1] colors and [-1,1] octahedral normals
+	glBindVertexArray(tris_vao);
+	const GLsizei stride = colored ? sizeof(QuantizedVertex) : sizeof(QuantizedUncoloredVertex);
+
+	// location=0 is the vertex, both layouts start the same way
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(QuantizedVertex, position)));
+
+	// location=1 is the color
+	if (colored)
+		glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(QuantizedVertex, color)));
+
+	// location=2 is the normal
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(colored ? offsetof(QuantizedVertex, normal) : offsetof(QuantizedUncoloredVertex, normal)));
+
+	// The game loop draws with this vao bound, leave it that way
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void
+update_mesh_stream()
+{
+	using namespace Globals;
+
+	if (!meshStream.sized())
+		return;
+
+	Stopwatch uploadTimer;
+	const TriMesh& streamed = meshStream.mesh();
+
+	// The final sizes are known up front, so allocate once and fill in place
+	if (!streamBuffersSized) {
+		const size_t maxVertices = meshStream.capacity_vertices();
+		if (kInterleavedVertices) {
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+		} else {
+			glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vec3f), nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vec3f), nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vec3f), nullptr, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// The element buffer is part of the VAO, it is bound for the whole game loop
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshStream.capacity_triangles() * sizeof(Vec3i), nullptr, GL_STATIC_DRAW);
+		streamBuffersSized = true;
+	}
+
+	// Triangles first, the vertices they use are always ready before them
+	const size_t readyTriangles = meshStream.ready_triangles();
+	const size_t readyVertices = meshStream.ready_vertices();
+
+	if (readyVertices > streamedVertices && kInterleavedVertices) {
+		std::vector<Vertex> packed;
+		interleave_arrays(streamed.arrays(), streamedVertices, readyVertices, packed);
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(streamedVertices * sizeof(Vertex)), GLsizeiptr(packed.size() * sizeof(Vertex)), packed.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		streamedVertices = readyVertices;
+	} else if (readyVertices > streamedVertices) {
+		const GLintptr offset = GLintptr(streamedVertices * sizeof(Vec3f));
+		const GLsizeiptr bytes = GLsizeiptr((readyVertices - streamedVertices) * sizeof(Vec3f));
+		glBindBuffer(GL_ARRAY_BUFFER, verts_vbo[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, &streamed.vertices[streamedVertices]);
+		glBindBuffer(GL_ARRAY_BUFFER, colors_vbo[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, &streamed.colors[streamedVertices]);
+		glBindBuffer(GL_ARRAY_BUFFER, normals_vbo[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, &streamed.normals[streamedVertices]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		streamedVertices = readyVertices;
+	}
+
+	if (readyTriangles > streamedTriangles) {
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(streamedTriangles * sizeof(Vec3i)),
+			GLsizeiptr((readyTriangles - streamedTriangles) * sizeof(Vec3i)), &streamed.faces[streamedTriangles]);
+		streamedTriangles = readyTriangles;
+		num_indices = GLsizei(streamedTriangles * 3);
+	}
+
+	// Let the loader finish up once it has nothing left for us
+	streamUploadMs += uploadTimer.lap();
+	if (meshStream.geometry_done() && streamedTriangles == meshStream.ready_triangles())
+		meshStream.all_uploaded();
+
+	if (!meshStream.finished())
+		return;
+
+	meshStream.join();
+	streaming = false;
+
+	if (meshStream.failed())
+		return;
+
+	// The final mesh can differ from what was streamed (recomputed normals, a new
+	// order, quantization, index chunks), upload it again as a whole
+	mesh = std::move(meshStream.mesh());
+	upload_mesh(mesh.arrays());
+	streamUploadMs += uploadTimer.lap();
+
+	mesh.print_details();
+	mesh.report.upload_ms = streamUploadMs;
+	finish_load_report(mesh.report);
+}
+
+void
+finish_load_report(LoadReport& report)
+{
+	report.print(std::cout);
+
+	if (!kWriteLoadReport)
+		return;
+
+	std::ofstream out(report.file + ".loadreport.json", std::ios::trunc);
+	report.write_json(out);
+	out << '\n';
+	if (!out)
+		std::cerr << "Could not write load report " << report.file << ".loadreport.json\n";
+}
+
+
+bool
+open_mesh_pages(const std::string& objFile, const ObjLoadOptions& loadOptions, bool cacheHit)
+{
+	using namespace Globals;
+
+	// Only the pages near the camera are ever resident, the whole mesh never is.
+	// The cache stays mapped just long enough to build the pages from it.
+	if (meshPager.open(objFile)) {
+		meshCache.close();
+		return true;
+	}
+
+	// No (current) paged file yet, build one. The mapped cache can be bigger than
+	// memory, so it's paged from directly. Without one the OBJ is streamed into
+	// pages, the paged file is what later launches start from.
+	bool built;
+	if (cacheHit) {
+		built = MeshPager::build(objFile, meshCache.arrays());
+		meshCache.close();
+	} else {
+		meshCache.close();
+		built = MeshPager::build_from_obj(objFile, loadOptions);
+	}
+	if (!built)
+		return false;
+
+	return meshPager.open(objFile);
+}
+
+
+void
+update_mesh_pages()
+{
+	using namespace Globals;
+
+	meshPager.update(gEyePos, gViewDir);
+
+	std::vector<uint32_t> evicted;
+	meshPager.take_evicted(evicted);
+	for (uint32_t page : evicted) {
+		auto found = residentPages.find(page);
+		if (found == residentPages.end())
+			continue;
+
+		glDeleteVertexArrays(1, &found->second.vao);
+		glDeleteBuffers(1, &found->second.vbo);
+		glDeleteBuffers(1, &found->second.ibo);
+		residentPages.erase(found);
+	}
+
+	// Pages come in as positions, normals, colors back to back, then the indices
+	std::vector<MeshPager::PageData> loaded;
+	meshPager.take_loaded(loaded);
+	for (const MeshPager::PageData& data : loaded) {
+		PageBuffers buffers;
+		const size_t attributeBytes = data.num_vertices * sizeof(Vec3f);
+
+		glGenVertexArrays(1, &buffers.vao);
+		glBindVertexArray(buffers.vao);
+
+		glGenBuffers(1, &buffers.vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers.vbo);
+		glBufferData(GL_ARRAY_BUFFER, 3 * attributeBytes, data.vertices(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &buffers.ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.num_triangles * 3 * sizeof(uint32_t), data.indices(), GL_STATIC_DRAW);
+		buffers.num_indices = GLsizei(data.num_triangles * 3);
+
+		// location=0 is the vertex, location=1 is the color, location=2 is the normal
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), nullptr);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), reinterpret_cast<void*>(2 * attributeBytes));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), reinterpret_cast<void*>(attributeBytes));
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		residentPages[data.page] = buffers;
+	}
+}
+
+
+void
+draw_mesh_pages()
+{
+	using namespace Globals;
+
+	for (const auto& [page, buffers] : residentPages) {
+		glBindVertexArray(buffers.vao);
+		glDrawElements(GL_TRIANGLES, buffers.num_indices, GL_UNSIGNED_INT, nullptr);
+	}
+
+	glBindVertexArray(tris_vao);
+}
+
+
 void
 calculate_viewing_matrix()
 {
 	Vector3Df n = Globals::gViewDir;
-	n.NormalizeSelf();
+	n.normalize();
 	n *= -1.f;
 	
-	Vector3Df u = Globals::gUpDir.CrossProduct(n);
-	u.NormalizeSelf();
+	Vector3Df u = Globals::gUpDir.cross(n);
+	u.normalize();
 
-	Vector3Df v = n.CrossProduct(u);
-	v.NormalizeSelf();
+	Vector3Df v = n.cross(u);
+	v.normalize();
 
-	Globals::gViewMatrix[0] = u.dx;
-	Globals::gViewMatrix[1] = v.dx;
-	Globals::gViewMatrix[2] = n.dx;
+	Globals::gViewMatrix[0] = u.x();
+	Globals::gViewMatrix[1] = v.x();
+	Globals::gViewMatrix[2] = n.x();
 	Globals::gViewMatrix[3] = 0;
 
-	Globals::gViewMatrix[4] = u.dy;
-	Globals::gViewMatrix[5] = v.dy;
-	Globals::gViewMatrix[6] = n.dy;
+	Globals::gViewMatrix[4] = u.y();
+	Globals::gViewMatrix[5] = v.y();
+	Globals::gViewMatrix[6] = n.y();
 	Globals::gViewMatrix[7] = 0;
 
-	Globals::gViewMatrix[8] = u.dz;
-	Globals::gViewMatrix[9] = v.dz;
-	Globals::gViewMatrix[10] = n.dz;
+	Globals::gViewMatrix[8] = u.z();
+	Globals::gViewMatrix[9] = v.z();
+	Globals::gViewMatrix[10] = n.z();
 	Globals::gViewMatrix[11] = 0;
 
-	Globals::gViewMatrix[12] = -Globals::gEyePos.DotProduct(u);
-	Globals::gViewMatrix[13] = -Globals::gEyePos.DotProduct(v);
-	Globals::gViewMatrix[14] = -Globals::gEyePos.DotProduct(n);
+	Globals::gViewMatrix[12] = -Globals::gEyePos.dot(u);
+	Globals::gViewMatrix[13] = -Globals::gEyePos.dot(v);
+	Globals::gViewMatrix[14] = -Globals::gEyePos.dot(n);
 	Globals::gViewMatrix[15] = 1;
 }
 
@@ -445,17 +995,17 @@ void
 calculate_viewing_matrix_for_eye_change()
 {
 	Vector3Df n = Globals::gViewDir;
-	n.NormalizeSelf();
+	n.normalize();
 	n *= -1.f;
 
-	Vector3Df u = Globals::gUpDir.CrossProduct(n);
-	u.NormalizeSelf();
+	Vector3Df u = Globals::gUpDir.cross(n);
+	u.normalize();
 
-	Vector3Df v = n.CrossProduct(u);
-	v.NormalizeSelf();
+	Vector3Df v = n.cross(u);
+	v.normalize();
 
-	Globals::gViewMatrix[12] = -Globals::gEyePos.DotProduct(u);
-	Globals::gViewMatrix[13] = -Globals::gEyePos.DotProduct(v);
-	Globals::gViewMatrix[14] = -Globals::gEyePos.DotProduct(n);
+	Globals::gViewMatrix[12] = -Globals::gEyePos.dot(u);
+	Globals::gViewMatrix[13] = -Globals::gEyePos.dot(v);
+	Globals::gViewMatrix[14] = -Globals::gEyePos.dot(n);
 }
 
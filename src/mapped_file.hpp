@@ -0,0 +1,149 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP 1
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+//
+//	Read-only memory mapped file
+//	The mapping stays valid for as long as the object lives,
+//	so anything pointing into data() must not outlive it.
+//
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile(){ close(); }
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	MappedFile( MappedFile &&other ) noexcept { swap(other); }
+	MappedFile& operator=( MappedFile &&other ) noexcept { close(); swap(other); return *this; }
+
+	// Maps the whole file, returns false if it can't be opened
+	inline bool open( const std::string &file );
+
+	// Unmaps the file (safe to call more than once)
+	inline void close();
+
+	bool is_open() const { return opened; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+	const char* begin() const { return bytes; }
+	const char* end() const { return bytes + length; }
+
+private:
+	const char *bytes = nullptr;
+	size_t length = 0;
+	bool opened = false;
+
+#ifdef _WIN32
+	HANDLE file_handle = INVALID_HANDLE_VALUE;
+	HANDLE mapping_handle = nullptr;
+#endif
+
+	void swap( MappedFile &other ) noexcept
+	{
+		std::swap(bytes, other.bytes);
+		std::swap(length, other.length);
+		std::swap(opened, other.opened);
+#ifdef _WIN32
+		std::swap(file_handle, other.file_handle);
+		std::swap(mapping_handle, other.mapping_handle);
+#endif
+	}
+};
+
+
+//
+//	Implementation
+//
+
+#ifdef _WIN32
+
+bool MappedFile::open( const std::string &file )
+{
+	close();
+
+	file_handle = CreateFileA( file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if( file_handle == INVALID_HANDLE_VALUE ){ return false; }
+
+	LARGE_INTEGER file_size;
+	if( !GetFileSizeEx( file_handle, &file_size ) ){ close(); return false; }
+	length = size_t(file_size.QuadPart);
+	opened = true;
+
+	// Empty files can't be mapped, but they're still valid files
+	if( length == 0 ){ return true; }
+
+	mapping_handle = CreateFileMappingA( file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if( mapping_handle == nullptr ){ close(); return false; }
+
+	bytes = static_cast<const char*>( MapViewOfFile( mapping_handle, FILE_MAP_READ, 0, 0, 0 ) );
+	if( bytes == nullptr ){ close(); return false; }
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( bytes ){ UnmapViewOfFile( bytes ); }
+	if( mapping_handle ){ CloseHandle( mapping_handle ); }
+	if( file_handle != INVALID_HANDLE_VALUE ){ CloseHandle( file_handle ); }
+	bytes = nullptr; length = 0; opened = false;
+	mapping_handle = nullptr; file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open( const std::string &file )
+{
+	close();
+
+	int fd = ::open( file.c_str(), O_RDONLY );
+	if( fd < 0 ){ return false; }
+
+	struct stat info;
+	if( fstat( fd, &info ) != 0 ){ ::close(fd); return false; }
+	length = size_t(info.st_size);
+	opened = true;
+
+	// Empty files can't be mapped, but they're still valid files
+	if( length == 0 ){ ::close(fd); return true; }
+
+	void *mapping = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close(fd); // the mapping keeps its own reference to the file
+	if( mapping == MAP_FAILED ){ length = 0; opened = false; return false; }
+
+	// We read front to back, let the kernel read ahead aggressively
+	madvise( mapping, length, MADV_SEQUENTIAL );
+
+	bytes = static_cast<const char*>( mapping );
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( bytes ){ munmap( const_cast<char*>(bytes), length ); }
+	bytes = nullptr; length = 0; opened = false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,367 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+
+// Matrix/Vector3D expression benchmark
+// Times the expression templates (core/Expression.hpp), and the Vec operators, against the same math written out by hand
+// on raw floats, and against the eager way (a Matrix or Vector3D for every intermediate result).
+//
+// Usage: math_bench [--count N] [--runs N] [--max-overhead X]
+//
+// Prints a single JSON object to stdout. "overhead" is expression time / hand-written time.
+// With --max-overhead the exit code is 1 if any case is above it or any result differs from
+// the hand-written one, so it can gate merges. It is always 1 if multiplying by a matrix with
+// pending transforms (a setter called, nothing read yet) goes wrong.
+
+#include "load_report.hpp"
+#include "core/Matrix.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Defaults, overridden on the command line
+const size_t kDefaultCount = 4096;
+const int kDefaultRuns = 9;
+
+// Results of one case, best run in nanoseconds per item
+struct BenchResult {
+	std::string name;
+	double expressionNs = 0.0;
+	double handNs = 0.0;
+	double eagerNs = 0.0;
+	bool matches = false;	// expression results are bit for bit the hand-written ones
+};
+
+// Inputs, every case reads its own slice
+struct BenchData {
+	std::vector<GLmatrix> matricesA;
+	std::vector<GLmatrix> matricesB;
+	std::vector<Vector3Df> vectorsA;
+	std::vector<Vector3Df> vectorsB;
+	std::vector<Vector3Df> vectorsC;
+	std::vector<std::array<float, 4>> points;
+	GLmatrix projection;
+	GLmatrix view;
+	GLmatrix model;
+};
+
+// The layer stays usable in constant expressions
+constexpr float
+constant_expression_check()
+{
+	GLmatrix a, b;
+	a[1] = 2.f;
+	b[12] = 3.f;
+	const std::array<float, 4> point = { 1.f, 2.f, 3.f, 1.f };
+	const std::array<float, 4> moved = a * b * point;
+	const Vector3Df sum = Vector3Df(1.f, 2.f, 3.f) + Vector3Df(1.f, 1.f, 1.f) * 2.f;
+	const GLmatrix combined = a * b + a * 2.f;
+	return moved[0] + sum.z() + combined(0, 1);
+}
+static_assert(constant_expression_check() == 5.f + 5.f + 6.f, "Expressions should evaluate at compile time");
+
+
+//
+// Helper functions
+//
+bool pending_transforms_check();
+
+BenchData make_data(size_t count);
+
+double best_ns_per_item(const std::function<void()>& body, size_t count, int runs);
+
+template<typename T>
+bool same_bits(const std::vector<T>& a, const std::vector<T>& b);
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results, size_t count, int runs);
+
+
+//
+//	Main
+//
+int
+main(int argc, char* argv[])
+{
+	size_t count = kDefaultCount;
+	int runs = kDefaultRuns;
+	double maxOverhead = 0.0;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--count" && hasValue)
+			count = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+		else if (arg == "--runs" && hasValue)
+			runs = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--max-overhead" && hasValue)
+			maxOverhead = std::atof(argv[++i]);
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--count N] [--runs N] [--max-overhead X]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	const BenchData data = make_data(count);
+	std::vector<BenchResult> results;
+
+	bool failed = false;
+	if (!pending_transforms_check()) {
+		std::cerr << "MultiplyBy, *= and * disagree on a matrix with pending transforms\n";
+		failed = true;
+	}
+
+	// projection * view * model * point, for a batch of points
+	{
+		BenchResult result;
+		result.name = "mvp_point";
+		std::vector<std::array<float, 4>> expression(count), hand(count), eager(count);
+		result.expressionNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++)
+				expression[i] = data.projection * data.view * data.model * data.points[i];
+		}, count, runs);
+		result.handNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				float modelPoint[4], viewPoint[4];
+				data.model.Transform(data.points[i].data(), modelPoint);
+				data.view.Transform(modelPoint, viewPoint);
+				data.projection.Transform(viewPoint, hand[i].data());
+			}
+		}, count, runs);
+		result.eagerNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				GLmatrix combined = data.projection;
+				combined.MultiplyBy(data.view);
+				combined.MultiplyBy(data.model);
+				combined.Transform(data.points[i].data(), eager[i].data());
+			}
+		}, count, runs);
+		result.matches = same_bits(expression, hand);
+		results.push_back(result);
+	}
+
+	// A chain of products into a Matrix
+	{
+		BenchResult result;
+		result.name = "matrix_chain";
+		std::vector<GLmatrix> expression(count), hand(count), eager(count);
+		result.expressionNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++)
+				expression[i] = data.matricesA[i] * data.matricesB[i] * data.model;
+		}, count, runs);
+		result.handNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				float partial[16];
+				GLmatrix::Multiply(data.matricesA[i], data.matricesB[i], partial);
+				GLmatrix::Multiply(partial, data.model, &hand[i][0]);
+			}
+		}, count, runs);
+		result.eagerNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				GLmatrix product = data.matricesA[i];
+				product.MultiplyBy(data.matricesB[i]);
+				product.MultiplyBy(data.model);
+				eager[i] = product;
+			}
+		}, count, runs);
+		result.matches = same_bits(expression, hand);
+		results.push_back(result);
+	}
+
+	// Element-wise matrix math
+	{
+		BenchResult result;
+		result.name = "matrix_scale_add";
+		std::vector<GLmatrix> expression(count), hand(count), eager(count);
+		const float scale = 0.5f;
+		result.expressionNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++)
+				expression[i] = data.matricesA[i] * scale + data.matricesB[i] - data.model;
+		}, count, runs);
+		result.handNs = best_ns_per_item([&] {
+			const float* model = data.model;
+			for (size_t i = 0; i < count; i++) {
+				const float* a = data.matricesA[i];
+				const float* b = data.matricesB[i];
+				float* out = &hand[i][0];
+				for (size_t k = 0; k < 16; k++)
+					out[k] = a[k] * scale + b[k] - model[k];
+			}
+		}, count, runs);
+		result.eagerNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				GLmatrix scaled = data.matricesA[i];
+				for (size_t k = 0; k < 16; k++)
+					scaled[k] *= scale;
+				GLmatrix sum = scaled;
+				for (size_t k = 0; k < 16; k++)
+					sum[k] += data.matricesB[i][k];
+				for (size_t k = 0; k < 16; k++)
+					sum[k] -= data.model[k];
+				eager[i] = sum;
+			}
+		}, count, runs);
+		result.matches = same_bits(expression, hand);
+		results.push_back(result);
+	}
+
+	// Element-wise vector math, Vec operators (core/Vec.hpp) are plain constexpr functions, no nodes
+	{
+		BenchResult result;
+		result.name = "vector_axpy";
+		std::vector<Vector3Df> expression(count), hand(count), eager(count);
+		const float scale = 1.5f;
+		result.expressionNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++)
+				expression[i] = data.vectorsA[i] + data.vectorsB[i] * scale - data.vectorsC[i];
+		}, count, runs);
+		result.handNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				const Vector3Df& a = data.vectorsA[i];
+				const Vector3Df& b = data.vectorsB[i];
+				const Vector3Df& c = data.vectorsC[i];
+				hand[i].x() = a.x() + b.x() * scale - c.x();
+				hand[i].y() = a.y() + b.y() * scale - c.y();
+				hand[i].z() = a.z() + b.z() * scale - c.z();
+			}
+		}, count, runs);
+		result.eagerNs = best_ns_per_item([&] {
+			for (size_t i = 0; i < count; i++) {
+				Vector3Df scaled = data.vectorsB[i];
+				scaled *= scale;
+				Vector3Df sum = data.vectorsA[i];
+				sum += scaled;
+				sum -= data.vectorsC[i];
+				eager[i] = sum;
+			}
+		}, count, runs);
+		result.matches = same_bits(expression, hand);
+		results.push_back(result);
+	}
+
+	for (const BenchResult& result : results) {
+		const double overhead = result.expressionNs / result.handNs;
+		std::cerr << result.name << ": expression " << result.expressionNs << " ns, hand-written " << result.handNs
+			<< " ns, eager " << result.eagerNs << " ns (" << overhead << "x)" << (result.matches ? "" : ", RESULTS DIFFER") << '\n';
+		if (maxOverhead > 0.0 && (overhead > maxOverhead || !result.matches))
+			failed = true;
+	}
+
+	write_json(std::cout, results, count, runs);
+	std::cout << '\n';
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// The setters only compose when the matrix is read, every product has to see them
+bool
+pending_transforms_check()
+{
+	// Every product gets its own right hand side, copies would compose it
+	GLmatrix right, rightA, rightB, rightC;
+	for (GLmatrix* matrix : { &right, &rightA, &rightB, &rightC }) {
+		matrix->RotateAroundYBy(0.5f);
+		matrix->TranslateXBy(3.f);
+	}
+
+	GLmatrix multiplied, assigned;
+	multiplied.MultiplyBy(rightA);
+	assigned *= rightB;
+	GLmatrix product = GLmatrix() * rightC;
+
+	float expected[16];
+	GLmatrix::Multiply(GLmatrix(), right, expected);
+	for (const GLmatrix* result : { &multiplied, &assigned, &product }) {
+		if (std::memcmp(static_cast<const float*>(*result), expected, sizeof(expected)) != 0)
+			return false;
+	}
+	return true;
+}
+
+BenchData
+make_data(size_t count)
+{
+	std::mt19937 random(2024);
+	std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+	BenchData data;
+	data.matricesA.resize(count);
+	data.matricesB.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		for (size_t k = 0; k < 16; k++) {
+			data.matricesA[i][k] = value(random);
+			data.matricesB[i][k] = value(random);
+		}
+	}
+	for (std::vector<Vector3Df>* vectors : { &data.vectorsA, &data.vectorsB, &data.vectorsC }) {
+		vectors->resize(count);
+		for (Vector3Df& vector : *vectors)
+			vector = Vector3Df(value(random), value(random), value(random));
+	}
+	data.points.resize(count);
+	for (std::array<float, 4>& point : data.points)
+		point = { value(random), value(random), value(random), 1.f };
+
+	data.model.SetTransforms(Vector3Df(2.f, 1.f, 0.5f), Vector3Df(0.1f, 0.7f, 0.f), Vector3Df(3.f, -1.f, 4.f));
+	data.view.RotateAroundYBy(0.3f);
+	data.view.TranslateZBy(-10.f);
+	for (size_t k = 0; k < 16; k++)
+		data.projection[k] = value(random);
+
+	return data;
+}
+
+double
+best_ns_per_item(const std::function<void()>& body, size_t count, int runs)
+{
+	double best = 0.0;
+	for (int run = 0; run < runs; ++run) {
+		Stopwatch timer;
+		body();
+		const double ms = timer.lap();
+		if (run == 0 || ms < best)
+			best = ms;
+	}
+	return best * 1e6 / double(count);
+}
+
+template<typename T>
+bool
+same_bits(const std::vector<T>& a, const std::vector<T>& b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (size_t i = 0; i < a.size(); i++) {
+		const T& x = a[i];
+		const T& y = b[i];
+		if constexpr (std::is_same_v<T, GLmatrix>) {
+			if (std::memcmp(static_cast<const float*>(x), static_cast<const float*>(y), sizeof(float) * 16) != 0)
+				return false;
+		} else if (std::memcmp(&x, &y, sizeof(T)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+write_json(std::ostream& out, const std::vector<BenchResult>& results, size_t count, int runs)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\"benchmark\":\"math_expressions\",\"count\":" << count << ",\"runs\":" << runs << ",\"cases\":[";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& result = results[i];
+		out << (i ? "," : "") << "{\"name\":\"" << result.name << "\",\"expression_ns\":" << result.expressionNs
+			<< ",\"hand_ns\":" << result.handNs << ",\"eager_ns\":" << result.eagerNs
+			<< ",\"overhead\":" << result.expressionNs / result.handNs
+			<< ",\"matches\":" << (result.matches ? "true" : "false") << "}";
+	}
+	out << "]}";
+}
@@ -0,0 +1,290 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include "mapped_file.hpp"
+#include "trimesh.hpp"
+
+//
+//	Binary mesh cache
+//
+//	A loaded TriMesh is written next to its OBJ as <file>.meshcache:
+//	a fixed header, then the raw vertex, normal, color and face arrays,
+//	each starting on a 64 byte boundary. An interleaved mesh is stored
+//	as one Vertex array instead, its normal and color offsets point
+//	inside the first vertex. A mesh with one color for every vertex
+//	has no color array, the header holds the color (an interleaved one
+//	reports no colors, its color slots aren't read). Later runs map the
+//	cache and hand the arrays straight to OpenGL, nothing is parsed or copied.
+//
+//	The cache is keyed by the OBJ's size, modification time and a hash
+//	of its contents, plus the load options that change the output.
+//	If the size differs it's stale. If only the mtime differs the OBJ
+//	is hashed again, so touching a file doesn't throw the cache away.
+//	A current cache is still checked before use: the arrays have to fit
+//	the file and every face index has to name a vertex.
+//
+//	Example use:
+//	MeshCache cache;
+//	if( !cache.open( obj, options ) ){
+//		mesh.load_obj( obj, options );
+//		MeshCache::write( obj, options, mesh.arrays() );
+//	}
+//
+class MeshCache {
+public:
+	static constexpr char magic[8] = { 'T','R','I','M','E','S','H','C' };
+	static constexpr uint32_t version = 4;
+	static constexpr size_t alignment = 64;
+
+	// On-disk header, all offsets are from the start of the file
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+		uint64_t source_size;
+		int64_t source_mtime;
+		uint64_t source_hash;
+		uint64_t options_key;
+		uint64_t num_vertices, num_normals, num_colors, num_faces;
+		uint64_t vertices_offset, normals_offset, colors_offset, faces_offset;
+		uint64_t vertex_stride;	// sizeof(Vec3f), or sizeof(Vertex) when interleaved
+		float constant_color[4];	// rgb of every vertex when num_colors is 0
+	};
+
+	// Path of the cache that belongs to an OBJ file
+	static std::string path_for( const std::string &obj_file ){ return obj_file + ".meshcache"; }
+
+	// Maps the cache for an OBJ, returns false if there is none or it's stale
+	inline bool open( const std::string &obj_file, const ObjLoadOptions &options );
+
+	// Writes (or replaces) the cache for an OBJ
+	static inline bool write( const std::string &obj_file, const ObjLoadOptions &options, const MeshArrays &arrays );
+
+	// Arrays inside the mapping, valid while the cache is open
+	const MeshArrays& arrays() const { return mesh_arrays; }
+
+	void close(){ mapped.close(); mesh_arrays = MeshArrays(); }
+
+	// Bytes mapped from the cache file
+	size_t mapped_size() const { return mapped.size(); }
+
+	// Hash used to detect changed source files
+	static inline uint64_t hash_bytes( const char *data, size_t size );
+
+	// Size and modification time of a source file
+	static inline bool source_info( const std::string &obj_file, uint64_t &size, int64_t &mtime );
+
+	// Hash of a source file's contents
+	static inline bool source_hash( const std::string &obj_file, uint64_t &hash );
+
+	// True if something built from a source of this size, mtime and hash is still current:
+	// the size is the same, and so is the mtime or, if only that changed, the contents
+	static inline bool source_current( const std::string &obj_file, uint64_t size, int64_t mtime, uint64_t hash );
+
+	// True if every index is below num_vertices, negative ones read as too big.
+	// Stale or damaged files can have the right sizes and still point anywhere.
+	static inline bool indices_in_range( const uint32_t *indices, size_t count, uint64_t num_vertices );
+
+	// Bits of the load options that change what load_obj produces
+	static uint64_t options_key( const ObjLoadOptions &options ){ return (options.weld_vertices ? 1 : 0) | (options.interleave ? 2 : 0) | (options.optimize ? 4 : 0); }
+
+private:
+	MappedFile mapped;
+	MeshArrays mesh_arrays;
+
+	static size_t align_up( size_t offset ){ return (offset + alignment - 1) & ~(alignment - 1); }
+};
+
+
+//
+//	Implementation
+//
+
+uint64_t MeshCache::hash_bytes( const char *data, size_t size )
+{
+	// Four independent multiply/rotate lanes over 8 byte words (xxHash style),
+	// good enough to tell changed files apart and runs near memory speed.
+	const uint64_t p1 = 0x9E3779B185EBCA87ULL, p2 = 0xC2B2AE3D27D4EB4FULL;
+	auto rotl = []( uint64_t x, int r ){ return (x << r) | (x >> (64 - r)); };
+	auto round = [&]( uint64_t acc, uint64_t word ){ return rotl( acc + word * p2, 31 ) * p1; };
+
+	uint64_t lanes[4] = { p1 + p2, p2, 0, 0 - p1 };
+	size_t i = 0;
+	for( ; i + 32 <= size; i += 32 ){
+		for( int l = 0; l < 4; ++l ){
+			uint64_t word; std::memcpy( &word, data + i + 8*l, 8 );
+			lanes[l] = round( lanes[l], word );
+		}
+	}
+	uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+	for( ; i < size; ++i ){ h = rotl( h ^ (uint8_t(data[i]) * p1), 11 ) * p2; }
+	h ^= h >> 33; h *= p2; h ^= h >> 29; h *= p1; h ^= h >> 32;
+	return h;
+}
+
+bool MeshCache::indices_in_range( const uint32_t *indices, size_t count, uint64_t num_vertices )
+{
+	// The largest index decides, a plain max vectorizes where an early out wouldn't
+	uint32_t largest = 0;
+	for( size_t i = 0; i < count; ++i ){ largest = std::max( largest, indices[i] ); }
+	return count == 0 || largest < num_vertices;
+}
+
+bool MeshCache::source_info( const std::string &obj_file, uint64_t &size, int64_t &mtime )
+{
+	std::error_code ec;
+	size = std::filesystem::file_size( obj_file, ec );
+	if( ec ){ return false; }
+	mtime = int64_t( std::filesystem::last_write_time( obj_file, ec ).time_since_epoch().count() );
+	return !ec;
+}
+
+bool MeshCache::source_hash( const std::string &obj_file, uint64_t &hash )
+{
+	MappedFile source;
+	if( !source.open( obj_file ) ){ return false; }
+	hash = hash_bytes( source.data(), source.size() );
+	return true;
+}
+
+bool MeshCache::source_current( const std::string &obj_file, uint64_t size, int64_t mtime, uint64_t hash )
+{
+	uint64_t source_size; int64_t source_mtime;
+	if( !source_info( obj_file, source_size, source_mtime ) || source_size != size ){ return false; }
+	if( source_mtime == mtime ){ return true; }
+
+	// Same size but touched since, only trust it if the contents still match
+	uint64_t source_contents;
+	return source_hash( obj_file, source_contents ) && source_contents == hash;
+}
+
+bool MeshCache::open( const std::string &obj_file, const ObjLoadOptions &options )
+{
+	close();
+
+	if( !std::filesystem::exists( obj_file ) || !mapped.open( path_for(obj_file) ) ){ return false; }
+
+	Header h;
+	if( mapped.size() < sizeof(Header) ){ close(); return false; }
+	std::memcpy( &h, mapped.data(), sizeof(Header) );
+	if( std::memcmp( h.magic, magic, sizeof(magic) ) != 0 || h.version != version || h.header_size != sizeof(Header) ){ close(); return false; }
+	if( h.options_key != options_key(options) ){ close(); return false; }
+	if( !source_current( obj_file, h.source_size, h.source_mtime, h.source_hash ) ){
+		std::cout << "Mesh cache for " << obj_file << " is stale" << std::endl;
+		close();
+		return false;
+	}
+
+	// Every array has to be aligned and lie inside the file, and hold one entry per vertex (or none)
+	const bool interleaved = h.vertex_stride == sizeof(Vertex);
+	if( !interleaved && h.vertex_stride != sizeof(Vec3f) ){ close(); return false; }
+	auto in_file = [&]( uint64_t offset, uint64_t count, size_t elem ){
+		return offset % alignment == 0 && offset <= mapped.size() && count <= (mapped.size() - offset) / elem;
+	};
+	const bool arrays_ok = interleaved ?
+		in_file( h.vertices_offset, h.num_vertices, sizeof(Vertex) ) && h.num_normals == h.num_vertices &&
+		( h.num_colors == h.num_vertices || h.num_colors == 0 ) &&
+		h.normals_offset == h.vertices_offset + offsetof(Vertex, normal) && h.colors_offset == h.vertices_offset + offsetof(Vertex, color) :
+		in_file( h.vertices_offset, h.num_vertices, sizeof(Vec3f) ) && in_file( h.normals_offset, h.num_normals, sizeof(Vec3f) ) &&
+		in_file( h.colors_offset, h.num_colors, sizeof(Vec3f) ) &&
+		( h.num_normals == h.num_vertices || h.num_normals == 0 ) && ( h.num_colors == h.num_vertices || h.num_colors == 0 );
+	if( !arrays_ok || !in_file( h.faces_offset, h.num_faces, sizeof(Vec3i) ) ){
+		close();
+		return false;
+	}
+
+	// One pass over the faces, they go straight to OpenGL and need_normals
+	if( !indices_in_range( reinterpret_cast<const uint32_t*>( mapped.data() + h.faces_offset ), h.num_faces * 3, h.num_vertices ) ){
+		std::cout << "Mesh cache for " << obj_file << " has faces outside its vertices" << std::endl;
+		close();
+		return false;
+	}
+
+	mesh_arrays.vertices = reinterpret_cast<const Vec3f*>( mapped.data() + h.vertices_offset );
+	mesh_arrays.normals = reinterpret_cast<const Vec3f*>( mapped.data() + h.normals_offset );
+	mesh_arrays.colors = reinterpret_cast<const Vec3f*>( mapped.data() + h.colors_offset );
+	mesh_arrays.faces = reinterpret_cast<const Vec3i*>( mapped.data() + h.faces_offset );
+	mesh_arrays.num_vertices = h.num_vertices;
+	mesh_arrays.num_normals = h.num_normals;
+	mesh_arrays.num_colors = h.num_colors;
+	mesh_arrays.num_faces = h.num_faces;
+	mesh_arrays.stride = size_t(h.vertex_stride);
+	mesh_arrays.constant_color = Vec3f( h.constant_color[0], h.constant_color[1], h.constant_color[2] );
+	if( interleaved ){ mesh_arrays.interleaved = reinterpret_cast<const Vertex*>( mapped.data() + h.vertices_offset ); }
+
+	std::cout << "\nLoaded cached mesh " << path_for(obj_file) << std::endl;
+	return true;
+}
+
+bool MeshCache::write( const std::string &obj_file, const ObjLoadOptions &options, const MeshArrays &a )
+{
+	static_assert( sizeof(Vec3f) == 3 * sizeof(float) && sizeof(Vec3i) == 3 * sizeof(int), "Vec must be tightly packed" );
+
+	Header h;
+	std::memcpy( h.magic, magic, sizeof(magic) );
+	h.version = version;
+	h.header_size = sizeof(Header);
+	if( !source_info( obj_file, h.source_size, h.source_mtime ) || !source_hash( obj_file, h.source_hash ) ){ return false; }
+	h.options_key = options_key(options);
+
+	h.num_vertices = a.num_vertices; h.num_normals = a.num_normals;
+	h.num_colors = a.num_colors; h.num_faces = a.num_faces;
+	h.vertex_stride = a.interleaved ? sizeof(Vertex) : sizeof(Vec3f);
+	for( int k = 0; k < 3; ++k ){ h.constant_color[k] = a.constant_color[k]; }
+	h.constant_color[3] = 1.f;
+	h.vertices_offset = align_up( sizeof(Header) );
+	if( a.interleaved ){
+		h.normals_offset = h.vertices_offset + offsetof(Vertex, normal);
+		h.colors_offset = h.vertices_offset + offsetof(Vertex, color);
+		h.faces_offset = align_up( h.vertices_offset + a.num_vertices * sizeof(Vertex) );
+	} else {
+		h.normals_offset = align_up( h.vertices_offset + a.num_vertices * sizeof(Vec3f) );
+		h.colors_offset = align_up( h.normals_offset + a.num_normals * sizeof(Vec3f) );
+		h.faces_offset = align_up( h.colors_offset + a.num_colors * sizeof(Vec3f) );
+	}
+
+	// Write to a temporary file and move it into place, so a crash
+	// halfway through never leaves a truncated cache behind
+	const std::string path = path_for(obj_file), temp_path = path + ".tmp";
+	{
+		std::ofstream out( temp_path, std::ios::binary | std::ios::trunc );
+		if( !out ){ return false; }
+
+		uint64_t written = 0;
+		auto put = [&]( uint64_t offset, const void *data, size_t bytes ){
+			static const char zeros[alignment] = {};
+			out.write( zeros, std::streamsize(offset - written) );
+			out.write( static_cast<const char*>(data), std::streamsize(bytes) );
+			written = offset + bytes;
+		};
+		put( 0, &h, sizeof(Header) );
+		if( a.interleaved ){
+			put( h.vertices_offset, a.interleaved, a.num_vertices * sizeof(Vertex) );
+		} else {
+			put( h.vertices_offset, a.vertices, a.num_vertices * sizeof(Vec3f) );
+			put( h.normals_offset, a.normals, a.num_normals * sizeof(Vec3f) );
+			put( h.colors_offset, a.colors, a.num_colors * sizeof(Vec3f) );
+		}
+		put( h.faces_offset, a.faces, a.num_faces * sizeof(Vec3i) );
+		if( !out ){ out.close(); std::filesystem::remove( temp_path ); return false; }
+	}
+
+	std::error_code ec;
+	std::filesystem::rename( temp_path, path, ec );
+	if( ec ){ std::filesystem::remove( temp_path, ec ); return false; }
+	return true;
+}
+
+#endif
@@ -0,0 +1,565 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_CODEC_HPP
+#define MESH_CODEC_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_quantize.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Compressed meshes
+//
+//	encode_mesh() turns a mesh into a few streams of small integers:
+//	- face indices, each as the difference to the first vertex no face
+//	  before it uses, 0 for every new vertex in an optimized (first use)
+//	  vertex order and small for the ones used recently, corner by corner
+//	- positions quantized to 16 bits in the bounding box, normals
+//	  octahedral encoded to 2 x 16 bits, colors as RGB8, each component
+//	  as the difference to the same component of the vertex before
+//	Differences are zigzag coded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...)
+//	so small negative ones are small numbers too, and every stream is cut
+//	into byte planes: the low bytes of all values, then the next bytes...
+//	The high planes are nearly all zeros.
+//
+//	Every plane is entropy coded in chunks of chunk_size bytes with an
+//	order 0 rANS coder, 12 bit probabilities and 4 interleaved states so
+//	the decoder's table lookups don't wait on each other. The states are
+//	refilled 16 bits at a time, at most once per symbol, so the decoder
+//	has no loops inside the loop. A chunk that rANS can't shrink by an
+//	eighth is stored as is, one holding a single value as that value.
+//	Chunks decode independently, on every thread.
+//
+//	Faces come back exactly, vertex attributes with the precision of
+//	mesh_quantize.hpp (a 65536th of the bounding box). decode_mesh()
+//	fills a TriMesh in either layout.
+//
+//	write_compressed_mesh() stores the encoded mesh next to its OBJ as
+//	<file>.meshz, keyed like the MeshCache so read_compressed_mesh()
+//	only accepts it for the same OBJ and load options.
+//
+//	Example use:
+//	if( !read_compressed_mesh( obj, options, mesh ) ){
+//		mesh.load_obj( obj, options );
+//		write_compressed_mesh( obj, options, mesh.arrays() );
+//	}
+//
+
+struct MeshCodecHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t source_size;	// key of the OBJ, see MeshCache::Header
+	int64_t source_mtime;
+	uint64_t source_hash;
+	uint64_t options_key;
+	uint64_t num_vertices, num_faces;
+	uint32_t flags;			// has normals 1, has colors 2, interleaved 4
+	uint32_t num_chunks;
+	float offset[3], scale[3];	// quantization box
+	float constant_color[4];
+};
+
+struct MeshCodecChunk {
+	uint32_t mode;	// mesh_codec::chunk_raw, chunk_rans or chunk_constant
+	uint32_t size;	// decoded bytes
+	uint64_t offset;	// from the start of the encoded mesh
+	uint64_t coded_size;
+};
+
+namespace mesh_codec {
+	static constexpr char magic[8] = { 'T','R','I','M','E','S','H','Z' };
+	static constexpr uint32_t version = 1;
+	static constexpr size_t chunk_size = size_t(1) << 18;
+
+	static constexpr uint32_t has_normals = 1, has_colors = 2, interleaved = 4;
+	static constexpr uint32_t chunk_raw = 0, chunk_rans = 1, chunk_constant = 2;
+
+	static constexpr uint32_t scale_bits = 12;	// probabilities are out of 4096
+	static constexpr uint32_t rans_low = uint32_t(1) << 16;	// states stay in [rans_low, 2^32), renormalized 16 bits at a time
+	static constexpr size_t table_bytes = 256 * sizeof(uint16_t);
+}
+
+// Order 0 rANS coding of a byte buffer: a 512 byte frequency table, the four
+// final states and the coded bytes. Appends to out, false if it didn't shrink by an eighth.
+static inline bool rans_encode( const uint8_t *data, size_t size, std::vector<uint8_t> &out );
+
+// Decodes exactly size bytes, false if the coded data is malformed
+static inline bool rans_decode( const uint8_t *coded, size_t coded_size, uint8_t *out, size_t size );
+
+// Encodes the mesh (either layout) into out
+static inline void encode_mesh( const MeshArrays &mesh, std::vector<uint8_t> &out, unsigned threads = 0 );
+
+// Decodes an encoded mesh into out, interleaved or split. False if the data is malformed.
+static inline bool decode_mesh( const uint8_t *data, size_t size, TriMesh &out, bool interleave = false, unsigned threads = 0 );
+
+// Path of the compressed mesh that belongs to an OBJ file
+static inline std::string compressed_mesh_path( const std::string &obj_file ){ return obj_file + ".meshz"; }
+
+// Writes (or replaces) the compressed mesh for an OBJ
+static inline bool write_compressed_mesh( const std::string &obj_file, const ObjLoadOptions &options, const MeshArrays &mesh );
+
+// Decodes the compressed mesh for an OBJ, false if there is none or it's stale
+static inline bool read_compressed_mesh( const std::string &obj_file, const ObjLoadOptions &options, TriMesh &out );
+
+
+//
+//	Implementation
+//
+
+static inline bool rans_encode( const uint8_t *data, size_t size, std::vector<uint8_t> &out )
+{
+	using namespace mesh_codec;
+	const uint32_t total = uint32_t(1) << scale_bits;
+	if( size == 0 ){ return false; }
+
+	// Counts scaled to 4096, every byte that occurs keeps at least 1
+	uint64_t counts[256] = {};
+	for( size_t i = 0; i < size; ++i ){ ++counts[ data[i] ]; }
+	uint32_t freq[256] = {}, start[256];
+	uint32_t sum = 0;
+	int biggest = 0;
+	for( int s = 0; s < 256; ++s ){
+		if( counts[s] == 0 ){ continue; }
+		freq[s] = std::max<uint32_t>( 1, uint32_t( counts[s] * total / size ) );
+		sum += freq[s];
+		if( counts[s] > counts[biggest] ){ biggest = s; }
+	}
+	if( counts[biggest] == size ){ return false; }
+	while( sum < total ){ ++freq[biggest]; ++sum; }
+	while( sum > total ){
+		// Take from whichever can spare it most
+		int most = -1;
+		for( int s = 0; s < 256; ++s ){ if( freq[s] > 1 && (most < 0 || freq[s] > freq[most]) ){ most = s; } }
+		--freq[most]; --sum;
+	}
+	for( int s = 0, c = 0; s < 256; ++s ){ start[s] = uint32_t(c); c += int(freq[s]); }
+
+	// The encoder runs backwards so the decoder reads forwards. A symbol never
+	// pushes more than one 16 bit word, so twice the input always fits.
+	std::vector<uint8_t> coded( size * 2 + 16 );
+	uint8_t *end = coded.data() + coded.size(), *p = end;
+	uint32_t state[4] = { rans_low, rans_low, rans_low, rans_low };
+	for( size_t i = size; i-- > 0; ){
+		uint32_t &x = state[i & 3];
+		const uint32_t f = freq[ data[i] ];
+		if( x >= ((rans_low >> scale_bits) << 16) * f ){
+			p -= 2;
+			const uint16_t word = uint16_t(x);
+			std::memcpy( p, &word, 2 );
+			x >>= 16;
+		}
+		x = ((x / f) << scale_bits) + (x % f) + start[ data[i] ];
+	}
+	for( int j = 3; j >= 0; --j ){
+		p -= 4;
+		std::memcpy( p, &state[j], 4 );
+	}
+
+	const size_t coded_size = size_t(end - p);
+	// Under an eighth saved isn't worth decoding symbol by symbol
+	if( table_bytes + coded_size > size - size / 8 ){ return false; }
+	const size_t at = out.size();
+	out.resize( at + table_bytes + coded_size );
+	for( int s = 0; s < 256; ++s ){
+		const uint16_t f = uint16_t(freq[s]);
+		std::memcpy( &out[at + s * 2], &f, 2 );
+	}
+	std::memcpy( &out[at + table_bytes], p, coded_size );
+	return true;
+}
+
+static inline bool rans_decode( const uint8_t *coded, size_t coded_size, uint8_t *out, size_t size )
+{
+	using namespace mesh_codec;
+	const uint32_t total = uint32_t(1) << scale_bits;
+	if( coded_size < table_bytes + 16 ){ return false; }
+
+	// One entry per slot: the byte, its frequency and how far into its range the slot is
+	uint32_t table[ size_t(1) << scale_bits ];
+	uint32_t slot = 0;
+	for( uint32_t s = 0; s < 256; ++s ){
+		uint16_t f;
+		std::memcpy( &f, coded + s * 2, 2 );
+		if( f >= total || slot + f > total ){ return false; }
+		for( uint32_t k = 0; k < f; ++k ){ table[slot++] = s | (uint32_t(f) << 8) | (k << 20); }
+	}
+	if( slot != total ){ return false; }
+
+	const uint8_t *p = coded + table_bytes, *end = coded + coded_size;
+	uint32_t state[4];
+	std::memcpy( state, p, 16 );
+	p += 16;
+
+	// A decoded state is at least 16, so one 16 bit word always brings it back above rans_low.
+	// Four symbols read at most 8 bytes, while that many are left the reads go unchecked and
+	// without branches.
+	auto decode = [&]( uint32_t &x ){
+		const uint32_t e = table[ x & (total - 1) ];
+		x = ((e >> 8) & 0xfff) * (x >> scale_bits) + (e >> 20);
+		uint16_t word;
+		std::memcpy( &word, p, 2 );
+		const uint32_t refill = x < rans_low;
+		x = refill ? (x << 16) | word : x;
+		p += refill * 2;
+		return uint8_t(e);
+	};
+	auto decode_checked = [&]( uint32_t &x ){
+		const uint32_t e = table[ x & (total - 1) ];
+		x = ((e >> 8) & 0xfff) * (x >> scale_bits) + (e >> 20);
+		if( x < rans_low && end - p >= 2 ){
+			uint16_t word;
+			std::memcpy( &word, p, 2 );
+			x = (x << 16) | word;
+			p += 2;
+		}
+		return uint8_t(e);
+	};
+
+	size_t i = 0;
+	for( ; i + 4 <= size && end - p >= 8; i += 4 ){
+		out[i] = decode( state[0] );
+		out[i+1] = decode( state[1] );
+		out[i+2] = decode( state[2] );
+		out[i+3] = decode( state[3] );
+	}
+	for( ; i < size; ++i ){ out[i] = decode_checked( state[i & 3] ); }
+
+	// A well formed stream ends with every state back where the encoder started
+	return p == end && state[0] == rans_low && state[1] == rans_low && state[2] == rans_low && state[3] == rans_low;
+}
+
+namespace mesh_codec {
+	static inline uint32_t zigzag( int32_t v ){ return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+	static inline int32_t unzigzag( uint32_t v ){ return int32_t(v >> 1) ^ -int32_t(v & 1); }
+	static inline uint16_t zigzag16( int16_t v ){ return uint16_t( (uint16_t(v) << 1) ^ uint16_t(v >> 15) ); }
+	static inline int16_t unzigzag16( uint16_t v ){ return int16_t( (v >> 1) ^ -int16_t(v & 1) ); }
+
+	// Byte planes of every stream, in the order they're stored: 4 for each corner's
+	// indices, 2 for each position and normal component, 1 for each color component
+	struct Planes {
+		static constexpr size_t positions = 12, normals_first = 18;
+
+		size_t num_faces = 0, num_vertices = 0;
+		bool normals = false, colors = false;
+
+		size_t colors_first() const { return normals ? 22 : 18; }
+		size_t count() const { return colors_first() + (colors ? 3 : 0); }
+		size_t size( size_t plane ) const { return plane < positions ? num_faces : num_vertices; }
+		size_t chunks( size_t plane ) const { return (size(plane) + chunk_size - 1) / chunk_size; }
+	};
+}
+
+static inline void encode_mesh( const MeshArrays &mesh, std::vector<uint8_t> &out, unsigned threads )
+{
+	using namespace mesh_codec;
+	const size_t nv = mesh.num_vertices, nf = mesh.num_faces;
+
+	QuantizedVertices q;
+	quantize_vertices( mesh, q, threads );
+
+	Planes layout;
+	layout.num_faces = nf;
+	layout.num_vertices = nv;
+	layout.normals = mesh.num_normals >= nv && nv > 0;
+	layout.colors = mesh.num_colors >= nv && nv > 0;
+	std::vector<std::vector<uint8_t>> planes( layout.count() );
+	for( size_t p = 0; p < planes.size(); ++p ){ planes[p].resize( layout.size(p) ); }
+
+	// Differences, zigzagged and cut into bytes
+	const size_t first_color_task = layout.normals ? 6 : 4;
+	parallel_tasks( first_color_task + (layout.colors ? 3 : 0), threads, [&]( size_t task ){
+		if( task == 0 ){
+			// Indices relative to the next vertex not used yet, which is what
+			// a new vertex is in first use order, and every corner on its own
+			uint32_t next = 0;
+			for( size_t f = 0; f < nf; ++f ){
+				for( int k = 0; k < 3; ++k ){
+					const uint32_t v = uint32_t( mesh.faces[f][k] );
+					const uint32_t z = zigzag( int32_t( v - next ) );
+					next = std::max( next, v + 1 );
+					for( int b = 0; b < 4; ++b ){ planes[k * 4 + b][f] = uint8_t( z >> (8 * b) ); }
+				}
+			}
+		} else if( task < first_color_task ){
+			const bool position = task < 4;
+			const int k = int(position ? task - 1 : task - 4);
+			const size_t first = (position ? Planes::positions : Planes::normals_first) + k * 2;
+			std::vector<uint8_t> &lo = planes[first], &hi = planes[first + 1];
+			uint16_t previous = 0;
+			for( size_t i = 0; i < nv; ++i ){
+				const uint16_t v = position ? q.vertices[i].position[k] : uint16_t( q.vertices[i].normal[k] );
+				const uint16_t z = zigzag16( int16_t( uint16_t( v - previous ) ) );
+				previous = v;
+				lo[i] = uint8_t(z);
+				hi[i] = uint8_t(z >> 8);
+			}
+		} else {
+			const int k = int(task - first_color_task);
+			std::vector<uint8_t> &plane = planes[ layout.colors_first() + k ];
+			uint8_t previous = 0;
+			for( size_t i = 0; i < nv; ++i ){
+				const uint8_t v = q.vertices[i].color[k];
+				plane[i] = uint8_t( (uint8_t(v - previous) << 1) ^ uint8_t( int8_t(v - previous) >> 7 ) );
+				previous = v;
+			}
+		}
+	});
+
+	// Entropy code every chunk on its own
+	std::vector<std::pair<size_t, size_t>> chunks;	// plane, first byte
+	for( size_t p = 0; p < planes.size(); ++p ){
+		for( size_t c = 0; c < layout.chunks(p); ++c ){ chunks.emplace_back( p, c * chunk_size ); }
+	}
+	std::vector<std::vector<uint8_t>> coded( chunks.size() );
+	std::vector<MeshCodecChunk> directory( chunks.size() );
+	parallel_tasks( chunks.size(), threads, [&]( size_t c ){
+		const std::vector<uint8_t> &plane = planes[ chunks[c].first ];
+		const uint8_t *data = plane.data() + chunks[c].second;
+		const size_t size = std::min( chunk_size, plane.size() - chunks[c].second );
+		MeshCodecChunk &chunk = directory[c];
+		chunk.size = uint32_t(size);
+		if( std::all_of( data, data + size, [&]( uint8_t b ){ return b == data[0]; } ) ){
+			chunk.mode = chunk_constant;
+			coded[c].assign( 1, data[0] );
+		} else if( rans_encode( data, size, coded[c] ) ){
+			chunk.mode = chunk_rans;
+		} else {
+			chunk.mode = chunk_raw;
+			coded[c].assign( data, data + size );
+		}
+		chunk.coded_size = coded[c].size();
+	});
+
+	MeshCodecHeader h = {};
+	std::memcpy( h.magic, magic, sizeof(magic) );
+	h.version = version;
+	h.header_size = sizeof(MeshCodecHeader);
+	h.num_vertices = nv;
+	h.num_faces = mesh.num_faces;
+	h.flags = (layout.normals ? has_normals : 0) | (layout.colors ? has_colors : 0) | (mesh.interleaved ? interleaved : 0);
+	h.num_chunks = uint32_t(chunks.size());
+	for( int k = 0; k < 3; ++k ){
+		h.offset[k] = q.offset[k];
+		h.scale[k] = q.scale[k];
+		h.constant_color[k] = mesh.constant_color[k];
+	}
+	h.constant_color[3] = 1.f;
+
+	size_t offset = sizeof(MeshCodecHeader) + directory.size() * sizeof(MeshCodecChunk);
+	for( MeshCodecChunk &chunk : directory ){
+		chunk.offset = offset;
+		offset += chunk.coded_size;
+	}
+	out.resize( offset );
+	std::memcpy( out.data(), &h, sizeof(h) );
+	if( !directory.empty() ){ std::memcpy( out.data() + sizeof(h), directory.data(), directory.size() * sizeof(MeshCodecChunk) ); }
+	for( size_t c = 0; c < coded.size(); ++c ){
+		if( !coded[c].empty() ){ std::memcpy( out.data() + directory[c].offset, coded[c].data(), coded[c].size() ); }
+	}
+}
+
+static inline bool decode_mesh( const uint8_t *data, size_t size, TriMesh &out, bool interleave, unsigned threads )
+{
+	using namespace mesh_codec;
+	MeshCodecHeader h;
+	if( size < sizeof(h) ){ return false; }
+	std::memcpy( &h, data, sizeof(h) );
+	if( std::memcmp( h.magic, magic, sizeof(magic) ) != 0 || h.version != version || h.header_size != sizeof(h) ){ return false; }
+	if( h.num_faces > uint64_t(std::numeric_limits<uint32_t>::max()) || h.num_vertices > uint64_t(std::numeric_limits<int>::max()) ){ return false; }
+
+	Planes layout;
+	layout.num_faces = size_t(h.num_faces);
+	layout.num_vertices = size_t(h.num_vertices);
+	layout.normals = (h.flags & has_normals) != 0;
+	layout.colors = (h.flags & has_colors) != 0;
+	size_t num_chunks = 0;
+	for( size_t p = 0; p < layout.count(); ++p ){ num_chunks += layout.chunks(p); }
+	if( h.num_chunks != num_chunks || (size - sizeof(h)) / sizeof(MeshCodecChunk) < num_chunks ){ return false; }
+	std::vector<MeshCodecChunk> directory( num_chunks );
+	if( num_chunks > 0 ){ std::memcpy( directory.data(), data + sizeof(h), num_chunks * sizeof(MeshCodecChunk) ); }
+
+	// Entropy decode every chunk into its plane
+	std::vector<std::vector<uint8_t>> planes( layout.count() );
+	std::vector<uint8_t*> targets;
+	targets.reserve( num_chunks );
+	for( size_t p = 0; p < planes.size(); ++p ){
+		planes[p].resize( layout.size(p) );
+		for( size_t c = 0; c < layout.chunks(p); ++c ){ targets.push_back( planes[p].data() + c * chunk_size ); }
+	}
+	std::vector<uint8_t> chunk_ok( num_chunks, 0 );
+	size_t next = 0;
+	for( size_t p = 0; p < planes.size(); ++p ){
+		for( size_t c = 0; c < layout.chunks(p); ++c, ++next ){
+			if( directory[next].size != std::min( chunk_size, planes[p].size() - c * chunk_size ) ){ return false; }
+		}
+	}
+	parallel_tasks( num_chunks, threads, [&]( size_t c ){
+		const MeshCodecChunk &chunk = directory[c];
+		if( chunk.offset > size || chunk.coded_size > size - chunk.offset ){ return; }
+		const uint8_t *coded = data + chunk.offset;
+		if( chunk.mode == chunk_constant && chunk.coded_size == 1 ){
+			std::memset( targets[c], coded[0], chunk.size );
+		} else if( chunk.mode == chunk_raw && chunk.coded_size == chunk.size ){
+			std::memcpy( targets[c], coded, chunk.size );
+		} else if( chunk.mode != chunk_rans || !rans_decode( coded, size_t(chunk.coded_size), targets[c], chunk.size ) ){
+			return;
+		}
+		chunk_ok[c] = 1;
+	});
+	if( std::find( chunk_ok.begin(), chunk_ok.end(), 0 ) != chunk_ok.end() ){ return false; }
+
+	// Undo the differences straight into the mesh
+	const size_t nv = layout.num_vertices, nf = layout.num_faces;
+	out = TriMesh();
+	out.faces.resize( h.num_faces );
+	out.constant_color = Vec3f( h.constant_color[0], h.constant_color[1], h.constant_color[2] );
+	if( interleave ){
+		out.packed.resize( nv );
+		out.packed_constant_color = !layout.colors;
+	} else {
+		out.vertices.resize( nv );
+		if( layout.normals ){ out.normals.resize( nv ); }
+		if( layout.colors ){ out.colors.resize( nv ); }
+	}
+	Vec3f *positions = interleave ? nullptr : out.vertices.data();
+	Vec3f *normals = interleave ? nullptr : out.normals.data();
+	Vec3f *colors = interleave ? nullptr : out.colors.data();
+	auto position = [&]( size_t i ) -> Vec3f& { return positions ? positions[i] : out.packed[i].position; };
+	auto normal = [&]( size_t i ) -> Vec3f& { return normals ? normals[i] : out.packed[i].normal; };
+	auto color = [&]( size_t i ) -> Vec3f& { return colors ? colors[i] : out.packed[i].color; };
+
+	std::vector<uint8_t> indices_ok( 1, 1 );
+	parallel_tasks( 1 + 3 + (layout.normals ? 1 : 0) + 1, threads, [&]( size_t task ){
+		if( task == 0 ){
+			// Put the bytes back together first, that much vectorizes
+			int *indices = reinterpret_cast<int*>( out.faces.data() );
+			for( int k = 0; k < 3; ++k ){
+				const uint8_t *b0 = planes[k * 4].data(), *b1 = planes[k * 4 + 1].data(), *b2 = planes[k * 4 + 2].data(), *b3 = planes[k * 4 + 3].data();
+				for( size_t f = 0; f < nf; ++f ){
+					indices[f * 3 + k] = int( uint32_t(b0[f]) | (uint32_t(b1[f]) << 8) | (uint32_t(b2[f]) << 16) | (uint32_t(b3[f]) << 24) );
+				}
+			}
+			uint32_t next = 0, bad = 0;
+			for( size_t i = 0; i < nf * 3; ++i ){
+				const uint32_t v = next + uint32_t( unzigzag( uint32_t(indices[i]) ) );
+				bad |= uint32_t( v >= nv );
+				next = std::max( next, v + 1 );
+				indices[i] = int(v);
+			}
+			indices_ok[0] = bad == 0;
+		} else if( task < 4 ){
+			const int k = int(task) - 1;
+			const uint8_t *lo = planes[Planes::positions + k * 2].data(), *hi = planes[Planes::positions + k * 2 + 1].data();
+			const float offset = h.offset[k], scale = h.scale[k] / 65535.f;
+			uint16_t value = 0;
+			for( size_t i = 0; i < nv; ++i ){
+				value = uint16_t( value + uint16_t( unzigzag16( uint16_t( lo[i] | (hi[i] << 8) ) ) ) );
+				position(i)[k] = offset + float(value) * scale;
+			}
+		} else if( task == 4 && layout.normals ){
+			int16_t value[2] = { 0, 0 };
+			for( size_t i = 0; i < nv; ++i ){
+				for( int k = 0; k < 2; ++k ){
+					const uint16_t z = uint16_t( planes[Planes::normals_first + k * 2][i] | (planes[Planes::normals_first + k * 2 + 1][i] << 8) );
+					value[k] = int16_t( uint16_t( uint16_t(value[k]) + uint16_t( unzigzag16(z) ) ) );
+				}
+				normal(i) = octahedral_decode( value );
+			}
+		} else if( layout.colors ){
+			const size_t first = layout.colors_first();
+			uint8_t value[3] = { 0, 0, 0 };
+			for( size_t i = 0; i < nv; ++i ){
+				Vec3f &c = color(i);
+				for( int k = 0; k < 3; ++k ){
+					const uint8_t z = planes[first + k][i];
+					value[k] = uint8_t( value[k] + uint8_t( (z >> 1) ^ -(z & 1) ) );
+					c[k] = float(value[k]) / 255.f;
+				}
+			}
+		} else if( interleave ){
+			for( size_t i = 0; i < nv; ++i ){ out.packed[i].color = out.constant_color; }
+		}
+	});
+	if( !indices_ok[0] ){ out = TriMesh(); return false; }
+
+	if( !layout.normals ){ out.need_normals(); }
+	return true;
+}
+
+static inline bool write_compressed_mesh( const std::string &obj_file, const ObjLoadOptions &options, const MeshArrays &mesh )
+{
+	std::vector<uint8_t> encoded;
+	encode_mesh( mesh, encoded, options.threads );
+
+	// Keyed like the MeshCache
+	MeshCodecHeader h;
+	std::memcpy( &h, encoded.data(), sizeof(h) );
+	if( !MeshCache::source_info( obj_file, h.source_size, h.source_mtime ) ){ return false; }
+	{
+		MappedFile source;
+		if( !source.open( obj_file ) ){ return false; }
+		h.source_hash = MeshCache::hash_bytes( source.data(), source.size() );
+	}
+	h.options_key = MeshCache::options_key( options );
+	std::memcpy( encoded.data(), &h, sizeof(h) );
+
+	// Temporary file first, so a crash never leaves half a file behind
+	const std::string path = compressed_mesh_path( obj_file ), temp_path = path + ".tmp";
+	{
+		std::ofstream out( temp_path, std::ios::binary | std::ios::trunc );
+		if( !out ){ return false; }
+		out.write( reinterpret_cast<const char*>( encoded.data() ), std::streamsize( encoded.size() ) );
+		if( !out ){ out.close(); std::filesystem::remove( temp_path ); return false; }
+	}
+	std::error_code ec;
+	std::filesystem::rename( temp_path, path, ec );
+	if( ec ){ std::filesystem::remove( temp_path, ec ); return false; }
+	return true;
+}
+
+static inline bool read_compressed_mesh( const std::string &obj_file, const ObjLoadOptions &options, TriMesh &out )
+{
+	uint64_t source_size; int64_t source_mtime;
+	if( !MeshCache::source_info( obj_file, source_size, source_mtime ) ){ return false; }
+	MappedFile mapped;
+	if( !mapped.open( compressed_mesh_path( obj_file ) ) || mapped.size() < sizeof(MeshCodecHeader) ){ return false; }
+
+	MeshCodecHeader h;
+	std::memcpy( &h, mapped.data(), sizeof(h) );
+	if( h.options_key != MeshCache::options_key( options ) || h.source_size != source_size ){ return false; }
+	if( h.source_mtime != source_mtime ){
+		MappedFile source;
+		if( !source.open( obj_file ) || MeshCache::hash_bytes( source.data(), source.size() ) != h.source_hash ){ return false; }
+	}
+
+	Stopwatch timer;
+	if( !decode_mesh( reinterpret_cast<const uint8_t*>( mapped.data() ), mapped.size(), out, options.interleave, options.threads ) ){
+		std::cout << "Compressed mesh " << compressed_mesh_path( obj_file ) << " is damaged" << std::endl;
+		return false;
+	}
+	out.report.file = obj_file;
+	out.report.source = "compressed";
+	out.report.bytes_read = mapped.size();
+	out.report.vertices = out.num_vertices();
+	out.report.faces = out.faces.size();
+	out.report.open_ms = timer.lap();
+
+	std::cout << "\nLoaded compressed mesh " << compressed_mesh_path( obj_file ) << std::endl;
+	return true;
+}
+
+#endif
@@ -0,0 +1,481 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_LOD_HPP
+#define MESH_LOD_HPP 1
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "index_chunks.hpp"
+#include "load_report.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Levels of detail from quadric error metrics
+//
+//	QuadricSimplifier is Garland and Heckbert's "Surface Simplification
+//	Using Quadric Error Metrics" restricted to collapsing an edge onto
+//	one of its two vertices. No vertex is created or moved, so every
+//	level is just another index list over the same vertex buffer.
+//	Each vertex's quadric sums the area weighted planes of its triangles;
+//	the cheapest collapse goes first and collapses that would flip a
+//	triangle are skipped.
+//
+//	Vertices on open edges never move. Those are the mesh's borders, seams
+//	where welding kept two vertices apart, and the borders between index
+//	chunks, so chunks drawn at different levels still meet without cracks.
+//
+//	The error of a level is the largest collapse cost spent reaching it,
+//	as the RMS distance (in object space) of the moved vertices from their
+//	original planes. select_lod() turns it into pixels on screen.
+//
+//	Simplifying takes a while on big meshes. ChunkLodBuilder does it on
+//	its own thread from a copy of the chunks and their positions, the
+//	render thread draws the full chunks until take() hands the levels over.
+//
+//	Example use:
+//	IndexChunks chunks;
+//	build_index_chunks( mesh.arrays(), chunks );
+//	std::vector<ChunkLods> lods;
+//	build_chunk_lods( mesh.arrays(), chunks, lods );
+//	< per frame, per chunk: const LodLevel &level = lods[c].levels[ select_lod( lods[c], ... ) ]; draw level >
+//
+//	ChunkLodBuilder builder;
+//	builder.start( mesh.arrays(), chunks );
+//	< per frame: if( builder.take( lods, chunks.indices ) ){ upload chunks.indices again } >
+//
+
+struct MeshLodOptions {
+	// Triangle count of each level relative to the full chunk
+	std::vector<float> ratios = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+	// A level is dropped, and the chain ends, if it doesn't get below
+	// this fraction of the previous level's triangles
+	float min_reduction = 0.95f;
+
+	unsigned threads = 0;
+
+	// Chunks not started once this is set are left without levels
+	const std::atomic<bool> *cancel = nullptr;
+};
+
+struct LodLevel {
+	uint32_t first_index = 0;	// into IndexChunks::indices
+	uint32_t num_indices = 0;
+	float error = 0.f;			// object space, 0 for the full chunk
+};
+
+struct ChunkLods {
+	Vec3f center;				// bounding sphere of the chunk
+	float radius = 0.f;
+	std::vector<LodLevel> levels;	// levels[0] is the chunk itself, coarser after it
+};
+
+//
+//	Simplifies one triangle list, coarser and coarser
+//
+class QuadricSimplifier {
+public:
+	inline QuadricSimplifier( const std::vector<Vec3f> &positions, const std::vector<uint32_t> &indices );
+
+	// Collapses edges until at most target_triangles are left or nothing can collapse,
+	// returns the largest error so far
+	inline float simplify( size_t target_triangles );
+
+	size_t num_triangles() const { return alive_faces; }
+
+	// Current triangles, in their original order
+	inline void get_indices( std::vector<uint32_t> &out ) const;
+
+private:
+	// Symmetric 4x4 matrix, a1 a2 a3 a4 / b2 b3 b4 / c3 c4 / d4, and the area it was built from
+	struct Quadric {
+		double a[10] = {};
+		double weight = 0.0;
+
+		inline void add_plane( double nx, double ny, double nz, double d, double w );
+		inline Quadric& operator+=( const Quadric &q );
+		inline double error( const Vec3f &p ) const;
+	};
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t from_stamp, to_stamp;
+		bool operator<( const Collapse &c ) const { return cost > c.cost; }	// cheapest on top
+	};
+
+	inline void push_edges( uint32_t v );
+	inline void push_collapse( uint32_t from, uint32_t to );
+	inline bool flips( uint32_t from, uint32_t to ) const;
+	inline void collapse( uint32_t from, uint32_t to );
+
+	const std::vector<Vec3f> &positions;
+	std::vector<uint32_t> corners;				// 3 per face, updated as vertices collapse
+	std::vector<bool> face_alive;
+	std::vector<std::vector<uint32_t>> vertex_faces;
+	std::vector<Quadric> quadrics;
+	std::vector<uint32_t> stamps;
+	std::vector<bool> locked, removed;
+	std::priority_queue<Collapse> queue;
+	size_t alive_faces = 0;
+	float max_error = 0.f;
+};
+
+// Appends a chain of coarser levels for every chunk to chunks.indices.
+// vertices is the buffer the chunks index, after gather_chunk_vertices() if it ran.
+static inline void build_chunk_lods( const MeshArrays &vertices, IndexChunks &chunks, std::vector<ChunkLods> &out, const MeshLodOptions &options = MeshLodOptions() );
+
+// Coarsest level whose error projects to at most max_pixels on screen.
+// projection_scale is the projection matrix's [5] (2n/(t-b)), distances are in object space.
+static inline size_t select_lod( const ChunkLods &lods, const Vec3f &eye, float projection_scale, float viewport_height, float max_pixels = 1.f );
+
+//
+//	Runs build_chunk_lods on a worker thread
+//
+class ChunkLodBuilder {
+public:
+	ChunkLodBuilder() {}
+	~ChunkLodBuilder(){ cancel(); join(); }
+
+	ChunkLodBuilder( const ChunkLodBuilder& ) = delete;
+	ChunkLodBuilder& operator=( const ChunkLodBuilder& ) = delete;
+
+	// Copies what it needs, so vertices and chunks can go away as soon as this returns.
+	// A build still running is cancelled and its levels are never handed over.
+	inline void start( const MeshArrays &vertices, const IndexChunks &chunks, const MeshLodOptions &options = MeshLodOptions() );
+
+	// Once the build is done, hands over the levels and the chunk indices with the levels appended
+	inline bool take( std::vector<ChunkLods> &lods, std::vector<uint16_t> &indices );
+
+	void cancel(){ stop_requested.store( true, std::memory_order_relaxed ); }
+	void join(){ if( worker.joinable() ){ worker.join(); } }
+
+	bool running() const { return worker.joinable() && !is_finished.load( std::memory_order_acquire ); }
+	size_t num_levels() const { return levels_built; }
+	double ms() const { return build_ms; }
+
+private:
+	std::thread worker;
+	std::vector<Vec3f> positions;
+	IndexChunks built_chunks;
+	std::vector<ChunkLods> built_lods;
+	size_t levels_built = 0;
+	double build_ms = 0.0;
+	std::atomic<bool> is_finished{ false };
+	std::atomic<bool> stop_requested{ false };
+};
+
+
+//
+//	Implementation
+//
+
+void QuadricSimplifier::Quadric::add_plane( double nx, double ny, double nz, double d, double w )
+{
+	a[0] += w*nx*nx; a[1] += w*nx*ny; a[2] += w*nx*nz; a[3] += w*nx*d;
+	a[4] += w*ny*ny; a[5] += w*ny*nz; a[6] += w*ny*d;
+	a[7] += w*nz*nz; a[8] += w*nz*d;
+	a[9] += w*d*d;
+	weight += w;
+}
+
+QuadricSimplifier::Quadric& QuadricSimplifier::Quadric::operator+=( const Quadric &q )
+{
+	for( int i = 0; i < 10; ++i ){ a[i] += q.a[i]; }
+	weight += q.weight;
+	return *this;
+}
+
+double QuadricSimplifier::Quadric::error( const Vec3f &p ) const
+{
+	const double x = p[0], y = p[1], z = p[2];
+	const double e = a[0]*x*x + 2.0*a[1]*x*y + 2.0*a[2]*x*z + 2.0*a[3]*x
+		+ a[4]*y*y + 2.0*a[5]*y*z + 2.0*a[6]*y
+		+ a[7]*z*z + 2.0*a[8]*z
+		+ a[9];
+	return std::max( e, 0.0 );
+}
+
+QuadricSimplifier::QuadricSimplifier( const std::vector<Vec3f> &positions_, const std::vector<uint32_t> &indices ) :
+	positions( positions_ ), corners( indices )
+{
+	const size_t nv = positions.size(), nf = corners.size() / 3;
+	corners.resize( nf * 3 );
+	face_alive.assign( nf, true );
+	vertex_faces.resize( nv );
+	quadrics.resize( nv );
+	stamps.assign( nv, 0 );
+	locked.assign( nv, false );
+	removed.assign( nv, false );
+	alive_faces = nf;
+
+	// Plane quadrics, weighted by triangle area
+	for( size_t f = 0; f < nf; ++f ){
+		const uint32_t *c = &corners[f*3];
+		const Vec3f &p0 = positions[c[0]], &p1 = positions[c[1]], &p2 = positions[c[2]];
+		Vec3f n = (p1 - p0).cross( p2 - p0 );
+		const float twice_area = float(n.len());
+		if( c[0] == c[1] || c[1] == c[2] || c[0] == c[2] ){
+			face_alive[f] = false;
+			--alive_faces;
+			continue;
+		}
+		for( int k = 0; k < 3; ++k ){ vertex_faces[c[k]].push_back( uint32_t(f) ); }
+		if( twice_area <= 0.f ){ continue; }
+		n *= 1.f / twice_area;
+		const double d = -double(n.dot( p0 ));
+		Quadric q;
+		q.add_plane( n[0], n[1], n[2], d, 0.5 * twice_area );
+		for( int k = 0; k < 3; ++k ){ quadrics[c[k]] += q; }
+	}
+
+	// Lock the ends of open edges, an edge seen once in either direction
+	std::vector<uint64_t> edges;
+	edges.reserve( alive_faces * 3 );
+	for( size_t f = 0; f < nf; ++f ){
+		if( !face_alive[f] ){ continue; }
+		for( int k = 0; k < 3; ++k ){
+			const uint64_t a = corners[f*3 + k], b = corners[f*3 + (k+1)%3];
+			edges.push_back( std::min(a, b) << 32 | std::max(a, b) );
+		}
+	}
+	std::sort( edges.begin(), edges.end() );
+	for( size_t i = 0; i < edges.size(); ){
+		size_t j = i + 1;
+		while( j < edges.size() && edges[j] == edges[i] ){ ++j; }
+		if( j - i == 1 ){
+			locked[ uint32_t(edges[i] >> 32) ] = true;
+			locked[ uint32_t(edges[i]) ] = true;
+		}
+		i = j;
+	}
+
+	for( size_t f = 0; f < nf; ++f ){
+		if( !face_alive[f] ){ continue; }
+		for( int k = 0; k < 3; ++k ){
+			const uint32_t a = corners[f*3 + k], b = corners[f*3 + (k+1)%3];
+			push_collapse( a, b );
+			push_collapse( b, a );
+		}
+	}
+}
+
+void QuadricSimplifier::push_edges( uint32_t v )
+{
+	for( uint32_t f : vertex_faces[v] ){
+		if( !face_alive[f] ){ continue; }
+		for( int k = 0; k < 3; ++k ){
+			const uint32_t w = corners[f*3 + k];
+			if( w == v ){ continue; }
+			push_collapse( v, w );
+			push_collapse( w, v );
+		}
+	}
+}
+
+void QuadricSimplifier::push_collapse( uint32_t from, uint32_t to )
+{
+	if( locked[from] ){ return; }
+	Quadric q = quadrics[from];
+	q += quadrics[to];
+	queue.push( Collapse{ q.error( positions[to] ), from, to, stamps[from], stamps[to] } );
+}
+
+bool QuadricSimplifier::flips( uint32_t from, uint32_t to ) const
+{
+	for( uint32_t f : vertex_faces[from] ){
+		if( !face_alive[f] ){ continue; }
+		const uint32_t *c = &corners[f*3];
+		if( c[0] == to || c[1] == to || c[2] == to ){ continue; }	// goes away
+
+		Vec3f before[3], after[3];
+		for( int k = 0; k < 3; ++k ){
+			before[k] = positions[c[k]];
+			after[k] = positions[ c[k] == from ? to : c[k] ];
+		}
+		const Vec3f n0 = (before[1] - before[0]).cross( before[2] - before[0] );
+		const Vec3f n1 = (after[1] - after[0]).cross( after[2] - after[0] );
+		if( n0.dot( n1 ) <= 0.f ){ return true; }
+	}
+	return false;
+}
+
+void QuadricSimplifier::collapse( uint32_t from, uint32_t to )
+{
+	for( uint32_t f : vertex_faces[from] ){
+		if( !face_alive[f] ){ continue; }
+		uint32_t *c = &corners[f*3];
+		if( c[0] == to || c[1] == to || c[2] == to ){
+			face_alive[f] = false;
+			--alive_faces;
+			continue;
+		}
+		for( int k = 0; k < 3; ++k ){ if( c[k] == from ){ c[k] = to; } }
+		vertex_faces[to].push_back( f );
+	}
+	vertex_faces[from].clear();
+	vertex_faces[from].shrink_to_fit();
+
+	// Drop the dead faces from the survivor's list now and then
+	std::vector<uint32_t> &faces = vertex_faces[to];
+	faces.erase( std::remove_if( faces.begin(), faces.end(), [&]( uint32_t f ){ return !face_alive[f]; } ), faces.end() );
+
+	quadrics[to] += quadrics[from];
+	removed[from] = true;
+	++stamps[from];
+	++stamps[to];
+	push_edges( to );
+}
+
+float QuadricSimplifier::simplify( size_t target_triangles )
+{
+	while( alive_faces > target_triangles && !queue.empty() ){
+		const Collapse c = queue.top();
+		queue.pop();
+		if( removed[c.from] || removed[c.to] || stamps[c.from] != c.from_stamp || stamps[c.to] != c.to_stamp ){ continue; }
+		if( flips( c.from, c.to ) ){ continue; }
+
+		const double weight = std::max( quadrics[c.from].weight + quadrics[c.to].weight, 1e-20 );
+		max_error = std::max( max_error, float( std::sqrt( c.cost / weight ) ) );
+		collapse( c.from, c.to );
+	}
+	return max_error;
+}
+
+void QuadricSimplifier::get_indices( std::vector<uint32_t> &out ) const
+{
+	out.clear();
+	out.reserve( alive_faces * 3 );
+	for( size_t f = 0; f < face_alive.size(); ++f ){
+		if( face_alive[f] ){ out.insert( out.end(), &corners[f*3], &corners[f*3] + 3 ); }
+	}
+}
+
+static inline void build_chunk_lods( const MeshArrays &vertices, IndexChunks &chunks, std::vector<ChunkLods> &out, const MeshLodOptions &options )
+{
+	const size_t num_chunks = chunks.chunks.size();
+	out.assign( num_chunks, ChunkLods() );
+	std::vector<std::vector<uint16_t>> lod_indices( num_chunks );
+
+	parallel_for( num_chunks, options.threads, [&]( size_t begin, size_t end ){
+		std::vector<Vec3f> positions;
+		std::vector<uint32_t> indices, simplified;
+		for( size_t c = begin; c < end; ++c ){
+			if( options.cancel && options.cancel->load( std::memory_order_relaxed ) ){ break; }
+			const IndexChunk &chunk = chunks.chunks[c];
+			ChunkLods &lods = out[c];
+
+			// The chunk's vertices, by their 16 bit index
+			indices.assign( chunks.indices.begin() + chunk.first_index, chunks.indices.begin() + chunk.first_index + chunk.num_indices );
+			uint32_t top = 0;
+			for( uint32_t i : indices ){ top = std::max( top, i + 1 ); }
+			positions.resize( top );
+			for( uint32_t i = 0; i < top; ++i ){ positions[i] = vertices.vertex( chunk.base_vertex + i ); }
+
+			Vec3f lo = positions.empty() ? Vec3f() : positions[0], hi = lo;
+			for( const Vec3f &p : positions ){
+				for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], p[k] ); hi[k] = std::max( hi[k], p[k] ); }
+			}
+			for( int k = 0; k < 3; ++k ){ lods.center[k] = 0.5f * (lo[k] + hi[k]); }
+			for( const Vec3f &p : positions ){ lods.radius = std::max( lods.radius, float( (p - lods.center).len() ) ); }
+
+			LodLevel full;
+			full.first_index = chunk.first_index;
+			full.num_indices = chunk.num_indices;
+			lods.levels.push_back( full );
+
+			// Each level keeps collapsing where the previous one stopped
+			QuadricSimplifier simplifier( positions, indices );
+			const size_t triangles = chunk.num_indices / 3;
+			size_t previous = simplifier.num_triangles();
+			for( float ratio : options.ratios ){
+				const float error = simplifier.simplify( size_t( double(triangles) * ratio ) );
+				if( simplifier.num_triangles() == 0 || double(simplifier.num_triangles()) > double(previous) * options.min_reduction ){ break; }
+				previous = simplifier.num_triangles();
+
+				simplifier.get_indices( simplified );
+				LodLevel level;
+				level.first_index = uint32_t(lod_indices[c].size());	// relative until appended below
+				level.num_indices = uint32_t(simplified.size());
+				level.error = error;
+				lods.levels.push_back( level );
+				for( uint32_t i : simplified ){ lod_indices[c].push_back( uint16_t(i) ); }
+			}
+		}
+	}, 1 );
+
+	// Append the levels after the full chunks
+	for( size_t c = 0; c < num_chunks; ++c ){
+		const uint32_t first = uint32_t(chunks.indices.size());
+		for( size_t l = 1; l < out[c].levels.size(); ++l ){ out[c].levels[l].first_index += first; }
+		chunks.indices.insert( chunks.indices.end(), lod_indices[c].begin(), lod_indices[c].end() );
+	}
+}
+
+static inline size_t select_lod( const ChunkLods &lods, const Vec3f &eye, float projection_scale, float viewport_height, float max_pixels )
+{
+	// Nearest point of the bounding sphere, inside it everything is full detail
+	const float distance = float( (eye - lods.center).len() ) - lods.radius;
+	if( distance <= 0.f ){ return 0; }
+
+	const float pixels_per_unit = projection_scale * 0.5f * viewport_height / distance;
+	size_t chosen = 0;
+	for( size_t l = 1; l < lods.levels.size(); ++l ){
+		if( lods.levels[l].error * pixels_per_unit > max_pixels ){ break; }
+		chosen = l;
+	}
+	return chosen;
+}
+
+void ChunkLodBuilder::start( const MeshArrays &vertices, const IndexChunks &chunks, const MeshLodOptions &options )
+{
+	cancel();
+	join();
+
+	// Only the positions are simplified, and only the chunks and their indices are read
+	positions.resize( vertices.num_vertices );
+	for( size_t v = 0; v < vertices.num_vertices; ++v ){ positions[v] = vertices.vertex( v ); }
+	built_chunks = IndexChunks();
+	built_chunks.chunks = chunks.chunks;
+	built_chunks.indices = chunks.indices;
+	built_lods.clear();
+	levels_built = 0;
+	is_finished.store( false, std::memory_order_relaxed );
+	stop_requested.store( false, std::memory_order_relaxed );
+
+	MeshLodOptions opts = options;
+	opts.cancel = &stop_requested;
+	worker = std::thread( [this, opts](){
+		Stopwatch timer;
+		MeshArrays arrays;
+		arrays.vertices = positions.data();
+		arrays.num_vertices = positions.size();
+		build_chunk_lods( arrays, built_chunks, built_lods, opts );
+		for( const ChunkLods &lods : built_lods ){ if( !lods.levels.empty() ){ levels_built += lods.levels.size() - 1; } }
+		build_ms = timer.lap();
+		is_finished.store( true, std::memory_order_release );
+	});
+}
+
+bool ChunkLodBuilder::take( std::vector<ChunkLods> &lods, std::vector<uint16_t> &indices )
+{
+	if( !worker.joinable() || !is_finished.load( std::memory_order_acquire ) ){ return false; }
+	join();
+	if( stop_requested.load( std::memory_order_relaxed ) ){ return false; }
+
+	lods.swap( built_lods );
+	indices.swap( built_chunks.indices );
+	built_lods.clear();
+	built_chunks = IndexChunks();
+	positions = std::vector<Vec3f>();
+	return true;
+}
+
+#endif
@@ -0,0 +1,345 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_OPTIMIZE_HPP
+#define MESH_OPTIMIZE_HPP 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include "load_report.hpp"
+#include "trimesh.hpp"
+
+//
+//	GPU friendly reordering of a loaded mesh
+//
+//	optimize_mesh() runs three passes, each keeping the mesh identical
+//	apart from the order of its triangles and vertices:
+//
+//	1. Triangles are reordered for the post-transform vertex cache with
+//	   Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Triangles
+//	   whose vertices are in a simulated LRU cache (or have few triangles
+//	   left) score highest and are emitted first.
+//	2. The result is cut into clusters where the cache starts over (or
+//	   where a cut costs little reuse), and the clusters are sorted so the ones facing away from the middle
+//	   of the mesh come first (Sander et al., "Fast Triangle Reordering
+//	   for Vertex Locality and Reduced Overdraw"). Outer surfaces are
+//	   drawn before what they hide, so early-Z throws more away.
+//	3. Vertices are renumbered in the order the triangles first use them,
+//	   so vertex fetch walks the buffers front to back.
+//
+//	Quality is measured as ACMR (vertex shader runs per triangle) and
+//	ATVR (vertex shader runs per vertex, 1 is ideal) on a FIFO cache.
+//	Only welded meshes share vertices, unwelded ones stay at ACMR 3.
+//
+//	Example use:
+//	mesh.load_obj( obj, options );
+//	MeshOptimizeStats stats = optimize_mesh( mesh );
+//	stats.print( std::cout );
+//
+
+struct MeshOptimizeOptions {
+	// Entries of the LRU cache the triangle order is scored against
+	unsigned cache_size = 32;
+
+	// Entries of the FIFO cache used to measure ACMR/ATVR
+	unsigned analyze_cache_size = 16;
+
+	// Clusters are only split further where their ACMR so far is within this
+	// factor of the whole cluster's, and once they have min_cluster_triangles.
+	// Bigger values give the overdraw sort more to work with but lose more
+	// vertex reuse at the cuts.
+	float overdraw_threshold = 1.05f;
+	unsigned min_cluster_triangles = 128;
+};
+
+struct VertexCacheStats {
+	double acmr = 0.0;	// transformed vertices per triangle
+	double atvr = 0.0;	// transformed vertices per vertex
+};
+
+struct MeshOptimizeStats {
+	VertexCacheStats before;
+	VertexCacheStats after;
+	size_t clusters = 0;
+	double ms = 0.0;
+
+	void print( std::ostream &out ) const
+	{
+		out << "Optimized mesh order in " << ms << " ms: ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr << " (" << clusters << " clusters)" << std::endl;
+	}
+};
+
+// Simulates a FIFO post-transform cache over the faces
+static inline VertexCacheStats analyze_vertex_cache( const std::vector<Vec3i> &faces, size_t num_vertices, unsigned cache_size = 16 );
+
+// Reorders faces for vertex cache hits, Forsyth's algorithm
+static inline void optimize_vertex_cache( std::vector<Vec3i> &faces, size_t num_vertices, unsigned cache_size = 32 );
+
+// Reorders clusters of cache optimized faces to reduce overdraw, returns the number of clusters
+static inline size_t optimize_overdraw( std::vector<Vec3i> &faces, const MeshArrays &mesh, const MeshOptimizeOptions &options = MeshOptimizeOptions() );
+
+// Renumbers the vertices in the order faces first reference them
+static inline void optimize_vertex_fetch( TriMesh &mesh );
+
+// All of the above
+static inline MeshOptimizeStats optimize_mesh( TriMesh &mesh, const MeshOptimizeOptions &options = MeshOptimizeOptions() );
+
+
+//
+//	Implementation
+//
+
+static inline VertexCacheStats analyze_vertex_cache( const std::vector<Vec3i> &faces, size_t num_vertices, unsigned cache_size )
+{
+	VertexCacheStats stats;
+	if( faces.empty() || num_vertices == 0 ){ return stats; }
+
+	// A vertex is in the cache if it went in less than cache_size misses ago
+	std::vector<size_t> inserted( num_vertices, 0 );
+	size_t misses = 0;
+	for( const Vec3i &f : faces ){
+		for( int k = 0; k < 3; ++k ){
+			size_t &when = inserted[ f[k] ];
+			if( when == 0 || misses - when >= cache_size ){ when = ++misses; }
+		}
+	}
+	stats.acmr = double(misses) / double(faces.size());
+	stats.atvr = double(misses) / double(num_vertices);
+	return stats;
+}
+
+
+static inline void optimize_vertex_cache( std::vector<Vec3i> &faces, size_t num_vertices, unsigned cache_size )
+{
+	const size_t nf = faces.size();
+	if( nf == 0 || num_vertices == 0 ){ return; }
+	cache_size = std::max( cache_size, 4u );
+
+	// Score tables from the paper
+	const int max_valence = 32;
+	std::vector<float> cache_score( cache_size ), valence_score( max_valence + 1 );
+	for( unsigned i = 0; i < cache_size; ++i ){
+		cache_score[i] = i < 3 ? 0.75f : std::pow( 1.f - float(i - 3) / float(cache_size - 3), 1.5f );
+	}
+	valence_score[0] = 0.f;
+	for( int i = 1; i <= max_valence; ++i ){ valence_score[i] = 2.f / std::sqrt( float(i) ); }
+	auto vertex_score = [&]( int cache_pos, uint32_t remaining ){
+		if( remaining == 0 ){ return -1.f; }
+		return ( cache_pos >= 0 ? cache_score[cache_pos] : 0.f ) + valence_score[ std::min<uint32_t>( remaining, max_valence ) ];
+	};
+
+	// Triangles of every vertex (CSR), the live ones are kept at the front
+	std::vector<uint32_t> remaining( num_vertices, 0 ), first( num_vertices + 1, 0 ), adjacency( nf * 3 );
+	for( const Vec3i &f : faces ){ for( int k = 0; k < 3; ++k ){ ++remaining[ f[k] ]; } }
+	for( size_t v = 0; v < num_vertices; ++v ){ first[v+1] = first[v] + remaining[v]; }
+	{
+		std::vector<uint32_t> fill( first.begin(), first.end() - 1 );
+		for( size_t t = 0; t < nf; ++t ){ for( int k = 0; k < 3; ++k ){ adjacency[ fill[ faces[t][k] ]++ ] = uint32_t(t); } }
+	}
+
+	std::vector<int> cache_pos( num_vertices, -1 );
+	std::vector<float> score( num_vertices ), tri_score( nf );
+	for( size_t v = 0; v < num_vertices; ++v ){ score[v] = vertex_score( -1, remaining[v] ); }
+	for( size_t t = 0; t < nf; ++t ){ tri_score[t] = score[ faces[t][0] ] + score[ faces[t][1] ] + score[ faces[t][2] ]; }
+
+	std::vector<char> emitted( nf, 0 );
+	std::vector<Vec3i> order;
+	order.reserve( nf );
+	std::vector<int> cache, next_cache;
+	cache.reserve( cache_size + 3 );
+	next_cache.reserve( cache_size + 3 );
+
+	size_t best = 0, cursor = 0;
+	float best_score = tri_score[0];
+	for( size_t t = 1; t < nf; ++t ){ if( tri_score[t] > best_score ){ best_score = tri_score[t]; best = t; } }
+
+	while( true ){
+		const Vec3i tri = faces[best];
+		emitted[best] = 1;
+		order.push_back( tri );
+
+		// Drop the triangle from its vertices' live lists
+		for( int k = 0; k < 3; ++k ){
+			const int v = tri[k];
+			uint32_t *list = &adjacency[ first[v] ];
+			uint32_t &count = remaining[v];
+			for( uint32_t i = 0; i < count; ++i ){
+				if( list[i] == best ){ list[i] = list[count-1]; --count; break; }
+			}
+		}
+
+		// Its vertices move to the front of the cache
+		next_cache.clear();
+		for( int k = 0; k < 3; ++k ){ next_cache.push_back( tri[k] ); }
+		for( int v : cache ){ if( v != tri[0] && v != tri[1] && v != tri[2] ){ next_cache.push_back( v ); } }
+		std::swap( cache, next_cache );
+
+		// Rescore everything that moved, and the triangles that use it
+		for( size_t i = 0; i < cache.size(); ++i ){
+			const int v = cache[i];
+			cache_pos[v] = i < cache_size ? int(i) : -1;
+			const float s = vertex_score( cache_pos[v], remaining[v] );
+			const float delta = s - score[v];
+			score[v] = s;
+			for( uint32_t j = 0; j < remaining[v]; ++j ){ tri_score[ adjacency[ first[v] + j ] ] += delta; }
+		}
+		if( cache.size() > cache_size ){ cache.resize( cache_size ); }
+
+		// Next triangle is the best one touching the cache
+		best_score = -1.f;
+		for( int v : cache ){
+			for( uint32_t j = 0; j < remaining[v]; ++j ){
+				const uint32_t t = adjacency[ first[v] + j ];
+				if( tri_score[t] > best_score ){ best_score = tri_score[t]; best = t; }
+			}
+		}
+
+		// Nothing left around the cache, carry on with the next unused triangle
+		if( best_score < 0.f ){
+			while( cursor < nf && emitted[cursor] ){ ++cursor; }
+			if( cursor == nf ){ break; }
+			best = cursor;
+		}
+	}
+
+	faces.swap( order );
+}
+
+
+static inline size_t optimize_overdraw( std::vector<Vec3i> &faces, const MeshArrays &mesh, const MeshOptimizeOptions &options )
+{
+	const size_t nf = faces.size();
+	if( nf == 0 ){ return 0; }
+
+	// Hard boundaries wherever the FIFO cache misses on every corner, the cache
+	// starts over there anyway so moving those clusters costs no vertex reuse
+	std::vector<uint8_t> missed( nf, 0 );
+	std::vector<size_t> hard = { 0 };
+	{
+		std::vector<size_t> inserted( mesh.num_vertices, 0 );
+		size_t misses = 0;
+		for( size_t t = 0; t < nf; ++t ){
+			for( int k = 0; k < 3; ++k ){
+				size_t &when = inserted[ faces[t][k] ];
+				if( when == 0 || misses - when >= options.analyze_cache_size ){ when = ++misses; ++missed[t]; }
+			}
+			if( missed[t] == 3 && t > 0 ){ hard.push_back( t ); }
+		}
+	}
+	hard.push_back( nf );
+
+	// Soft boundaries inside them, wherever the cluster so far does about as
+	// well as the whole one (Tipsify's lambda test)
+	std::vector<size_t> starts;
+	for( size_t h = 0; h + 1 < hard.size(); ++h ){
+		size_t cluster_misses = 0;
+		for( size_t t = hard[h]; t < hard[h+1]; ++t ){ cluster_misses += missed[t]; }
+		const double limit = options.overdraw_threshold * double(cluster_misses) / double(hard[h+1] - hard[h]);
+
+		size_t start = hard[h], misses = 0;
+		starts.push_back( start );
+		for( size_t t = hard[h]; t < hard[h+1]; ++t ){
+			misses += missed[t];
+			const size_t count = t + 1 - start;
+			if( count >= options.min_cluster_triangles && t + 1 < hard[h+1] && double(misses) / double(count) <= limit ){
+				start = t + 1;
+				misses = 0;
+				starts.push_back( start );
+			}
+		}
+	}
+	const size_t nc = starts.size();
+	starts.push_back( nf );
+	if( nc == 1 ){ return 1; }
+
+	// Area weighted centroid and normal of every cluster
+	std::vector<Vec3f> centroid( nc ), normal( nc );
+	std::vector<float> area( nc, 0.f );
+	Vec3f mesh_centroid;
+	float mesh_area = 0.f;
+	for( size_t c = 0; c < nc; ++c ){
+		for( size_t t = starts[c]; t < starts[c+1]; ++t ){
+			const Vec3f &p0 = mesh.vertex( faces[t][0] ), &p1 = mesh.vertex( faces[t][1] ), &p2 = mesh.vertex( faces[t][2] );
+			const Vec3f n = (p1-p0).cross( p2-p0 );
+			const float a = float( n.len() );
+			Vec3f mid = p0;
+			mid += p1;
+			mid += p2;
+			centroid[c] += mid * (a / 3.f);
+			normal[c] += n;
+			area[c] += a;
+		}
+		mesh_centroid += centroid[c];
+		mesh_area += area[c];
+		if( area[c] > 0.f ){ centroid[c] *= 1.f / area[c]; }
+		normal[c].normalize();
+	}
+	if( mesh_area > 0.f ){ mesh_centroid *= 1.f / mesh_area; }
+
+	// Clusters further out along their own normal are drawn first
+	std::vector<float> key( nc );
+	for( size_t c = 0; c < nc; ++c ){ key[c] = (centroid[c] - mesh_centroid).dot( normal[c] ); }
+	std::vector<uint32_t> cluster_order( nc );
+	std::iota( cluster_order.begin(), cluster_order.end(), 0u );
+	std::stable_sort( cluster_order.begin(), cluster_order.end(), [&]( uint32_t a, uint32_t b ){ return key[a] > key[b]; } );
+
+	std::vector<Vec3i> sorted;
+	sorted.reserve( nf );
+	for( uint32_t c : cluster_order ){ sorted.insert( sorted.end(), faces.begin() + starts[c], faces.begin() + starts[c+1] ); }
+	faces.swap( sorted );
+	return nc;
+}
+
+
+static inline void optimize_vertex_fetch( TriMesh &mesh )
+{
+	const size_t nv = mesh.num_vertices();
+	const uint32_t unused = uint32_t(-1);
+	std::vector<uint32_t> remap( nv, unused );
+	uint32_t next = 0;
+	for( Vec3i &f : mesh.faces ){
+		for( int k = 0; k < 3; ++k ){
+			uint32_t &id = remap[ f[k] ];
+			if( id == unused ){ id = next++; }
+			f[k] = int(id);
+		}
+	}
+	// Vertices no face uses go last, in their old order
+	for( uint32_t &id : remap ){ if( id == unused ){ id = next++; } }
+
+	auto permute = [&]( auto &array ){
+		if( array.size() != nv ){ return; }
+		std::remove_reference_t<decltype(array)> moved( nv );
+		for( size_t i = 0; i < nv; ++i ){ moved[ remap[i] ] = array[i]; }
+		array.swap( moved );
+	};
+	permute( mesh.packed );
+	permute( mesh.vertices );
+	permute( mesh.normals );
+	permute( mesh.colors );
+}
+
+
+static inline MeshOptimizeStats optimize_mesh( TriMesh &mesh, const MeshOptimizeOptions &options )
+{
+	MeshOptimizeStats stats;
+	Stopwatch timer;
+	const size_t nv = mesh.num_vertices();
+	stats.before = analyze_vertex_cache( mesh.faces, nv, options.analyze_cache_size );
+
+	optimize_vertex_cache( mesh.faces, nv, options.cache_size );
+	stats.clusters = optimize_overdraw( mesh.faces, mesh.arrays(), options );
+	optimize_vertex_fetch( mesh );
+	mesh.invalidate_adjacency();
+
+	stats.after = analyze_vertex_cache( mesh.faces, nv, options.analyze_cache_size );
+	stats.ms = timer.lap();
+	return stats;
+}
+
+#endif
@@ -0,0 +1,888 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_PAGES_HPP
+#define MESH_PAGES_HPP 1
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "trimesh.hpp"
+
+//
+//	Options for MeshPager
+//
+struct MeshPagerOptions {
+	// Pages closer than this to the eye are kept resident
+	float resident_radius = 25.f;
+
+	// Pages around eye + view_dir * prefetch_distance are loaded ahead of time
+	float prefetch_distance = 15.f;
+
+	// Upper bound for the bytes of all resident (or loading) pages
+	size_t budget_bytes = size_t(512) << 20;
+};
+
+
+//
+//	Out-of-core mesh paging
+//
+//	build() cuts a mesh into spatially coherent pages (a median split
+//	of the triangle centroids along the longest axis, until a page holds
+//	at most target_triangles) and writes them to <file>.meshpages. Every
+//	page is self contained: its own vertices, normals and colors, and
+//	faces indexed locally, starting on a 4 KiB boundary in the file.
+//	The file goes stale like a MeshCache, by the OBJ's size, mtime and hash.
+//	build() only keeps per-triangle and per-vertex bookkeeping in memory
+//	and just reads the mesh, so it can run straight off a memory mapped
+//	MeshCache that doesn't fit in memory (the OS pages it in and out).
+//
+//	build_from_obj() needs neither a TriMesh nor a cache. One pass over
+//	the OBJ writes its records to scratch files, which are mapped and
+//	read back. The split is then found pass by pass from histograms of
+//	the triangle centroids, and the pages are gathered a batch at a time,
+//	so what it holds in memory stays under memory_budget however big the
+//	scan is. It welds and gives normals like load_obj (welding is per
+//	page, vertices on a page border are in both).
+//
+//	At runtime only the page table is kept in memory. update() is given
+//	the camera and decides which pages should be resident: the ones near
+//	the eye, and the ones near a point ahead of it along the view
+//	direction (prefetch). Missing pages are read by a background thread,
+//	nearest first. When the resident set goes over budget the least
+//	recently wanted pages are evicted.
+//
+//	The pager doesn't touch OpenGL. take_loaded() hands over pages that
+//	finished reading (upload them, then drop the CPU copy), take_evicted()
+//	lists pages whose GPU buffers should be freed. A page whose indices
+//	point outside its vertices is never handed over, it stays missing.
+//
+class MeshPager {
+public:
+	static constexpr char magic[8] = { 'T','R','I','P','A','G','E','S' };
+	static constexpr uint32_t version = 2;
+	static constexpr size_t page_alignment = 4096;
+
+	// Page table entry, as stored in the file
+	struct Page {
+		float bounds_min[3];
+		float bounds_max[3];
+		uint64_t offset;
+		uint64_t bytes;
+		uint32_t num_vertices;
+		uint32_t num_triangles;
+	};
+
+	// A page read from disk
+	struct PageData {
+		uint32_t page = 0;
+		uint32_t num_vertices = 0;
+		uint32_t num_triangles = 0;
+		std::vector<char> bytes;
+
+		const Vec3f* vertices() const { return reinterpret_cast<const Vec3f*>( bytes.data() ); }
+		const Vec3f* normals() const { return vertices() + num_vertices; }
+		const Vec3f* colors() const { return normals() + num_vertices; }
+		const uint32_t* indices() const { return reinterpret_cast<const uint32_t*>( colors() + num_vertices ); }
+	};
+
+	static std::string path_for( const std::string &obj_file ){ return obj_file + ".meshpages"; }
+
+	// Partitions the mesh and writes the paged file for an OBJ
+	static inline bool build( const std::string &obj_file, const MeshArrays &mesh, uint32_t target_triangles = 1 << 16 );
+
+	// Same, streamed from the OBJ itself with bounded memory, see above
+	static inline bool build_from_obj( const std::string &obj_file, const ObjLoadOptions &options,
+		uint32_t target_triangles = 1 << 16, size_t memory_budget = size_t(256) << 20 );
+
+	MeshPager() {}
+	~MeshPager(){ close(); }
+
+	MeshPager( const MeshPager& ) = delete;
+	MeshPager& operator=( const MeshPager& ) = delete;
+
+	// Opens the paged file for an OBJ, returns false if missing or stale
+	inline bool open( const std::string &obj_file, const MeshPagerOptions &options = MeshPagerOptions() );
+	inline void close();
+
+	// Picks the wanted pages for this camera, queues reads and evictions
+	inline void update( const Vec3f &eye, const Vec3f &view_dir );
+
+	// Pages that finished reading since the last call
+	inline void take_loaded( std::vector<PageData> &loaded );
+
+	// Pages that were evicted since the last call
+	void take_evicted( std::vector<uint32_t> &evicted ){ evicted.swap( evicted_pages ); evicted_pages.clear(); }
+
+	const std::vector<Page>& pages() const { return page_table; }
+	size_t resident_bytes() const { return used_bytes; }
+
+private:
+	enum class State : uint8_t { unloaded, loading, resident, broken };
+
+	// On-disk header, followed by the page table
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_pages;
+		uint64_t source_size;
+		int64_t source_mtime;
+		uint64_t source_hash;
+		uint64_t table_offset;
+	};
+
+	MeshPagerOptions opts;
+	MappedFile mapped;
+	std::vector<Page> page_table;
+	std::vector<State> state;
+	std::vector<uint64_t> last_wanted;
+	uint64_t frame = 0;
+	size_t used_bytes = 0;
+	std::vector<uint32_t> evicted_pages;
+
+	// Loader thread
+	std::thread loader;
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::deque<uint32_t> requests;
+	std::vector<PageData> completed;
+	std::vector<uint32_t> rejected;	// pages read with indices out of range
+	bool stopping = false;
+
+	inline void load_pages();
+
+	static float distance2( const Page &p, const Vec3f &x )
+	{
+		float d2 = 0.f;
+		for( int i = 0; i < 3; ++i ){
+			float d = std::max( { p.bounds_min[i] - x[i], 0.f, x[i] - p.bounds_max[i] } );
+			d2 += d * d;
+		}
+		return d2;
+	}
+};
+
+
+//
+//	build_from_obj helpers
+//
+namespace pages_detail {
+
+// Written front to back, then mapped read-only. The file is removed with the object.
+class ScratchFile {
+public:
+	explicit ScratchFile( const std::string &file ) : path( file ), out( file, std::ios::binary | std::ios::trunc ) {}
+	~ScratchFile(){ mapped.close(); out.close(); std::error_code ec; std::filesystem::remove( path, ec ); }
+
+	ScratchFile( const ScratchFile& ) = delete;
+	ScratchFile& operator=( const ScratchFile& ) = delete;
+
+	template <typename T>
+	void put( const T &value ){ out.write( reinterpret_cast<const char*>(&value), sizeof(T) ); }
+
+	// Done writing, map what was written
+	bool finish(){ out.close(); return !out.fail() && mapped.open( path ); }
+
+	template <typename T>
+	const T* data() const { return reinterpret_cast<const T*>( mapped.data() ); }
+
+private:
+	std::string path;
+	std::ofstream out;
+	MappedFile mapped;
+};
+
+// A vertex record of the OBJ, colors default like in load_obj
+struct PositionColor {
+	Vec3f position;
+	Vec3f color;
+};
+
+// Node of the split of the triangle centroids. Every split cuts the
+// node's bounds along one axis into bins, bins up to split_bin go left.
+struct SplitNode {
+	Vec3f lo, hi;			// centroid bounds, loose once a parent's bins cut them
+	uint64_t count = 0;		// triangles
+	int axis = -1;			// -1 for a leaf
+	uint32_t split_bin = 0;
+	uint32_t child = 0;		// left child, the right one follows it
+	uint32_t page = 0;		// leaves only
+	bool done = false;		// a leaf that can't be split any further
+};
+
+static constexpr uint32_t split_bins = 256;
+
+static inline uint32_t split_bin_of( const SplitNode &n, int axis, float x )
+{
+	const float extent = n.hi[axis] - n.lo[axis];
+	const float f = extent > 0.f ? (x - n.lo[axis]) / extent * float(split_bins) : 0.f;
+	return f > 0.f ? std::min( uint32_t(f), split_bins - 1 ) : 0;	// NaNs go to bin 0
+}
+
+static inline uint32_t find_leaf( const std::vector<SplitNode> &nodes, const Vec3f &centroid )
+{
+	uint32_t i = 0;
+	while( nodes[i].axis >= 0 ){
+		const SplitNode &n = nodes[i];
+		i = n.child + ( split_bin_of( n, n.axis, centroid[n.axis] ) > n.split_bin ? 1 : 0 );
+	}
+	return i;
+}
+
+} // end namespace pages_detail
+
+
+//
+//	Implementation
+//
+
+bool MeshPager::build( const std::string &obj_file, const MeshArrays &mesh, uint32_t target_triangles )
+{
+	const size_t nf = mesh.num_faces;
+	if( nf == 0 || mesh.num_normals != mesh.num_vertices || (mesh.num_colors != mesh.num_vertices && mesh.num_colors != 0) ){ return false; }
+
+	// Centroids of every triangle, and the order we'll sort them in
+	std::vector<Vec3f> centroids( nf );
+	for( size_t f = 0; f < nf; ++f ){
+		const Vec3i &face = mesh.faces[f];
+		Vec3f c = mesh.vertex(face[0]);
+		c += mesh.vertex(face[1]);
+		c += mesh.vertex(face[2]);
+		centroids[f] = c * (1.f / 3.f);
+	}
+	std::vector<uint32_t> order( nf );
+	std::iota( order.begin(), order.end(), 0u );
+
+	// Median split along the longest axis until every range is small enough
+	std::vector<std::pair<size_t,size_t>> leaves, stack = { { 0, nf } };
+	while( !stack.empty() ){
+		auto [begin, end] = stack.back();
+		stack.pop_back();
+		if( end - begin <= target_triangles ){ leaves.push_back( { begin, end } ); continue; }
+
+		Vec3f lo = centroids[order[begin]], hi = lo;
+		for( size_t i = begin; i < end; ++i ){
+			for( int k = 0; k < 3; ++k ){
+				lo[k] = std::min( lo[k], centroids[order[i]][k] );
+				hi[k] = std::max( hi[k], centroids[order[i]][k] );
+			}
+		}
+		int axis = 0;
+		for( int k = 1; k < 3; ++k ){ if( hi[k] - lo[k] > hi[axis] - lo[axis] ){ axis = k; } }
+
+		const size_t mid = begin + (end - begin) / 2;
+		std::nth_element( order.begin() + begin, order.begin() + mid, order.begin() + end,
+			[&]( uint32_t a, uint32_t b ){ return centroids[a][axis] < centroids[b][axis]; } );
+		stack.push_back( { mid, end } );
+		stack.push_back( { begin, mid } );
+	}
+	centroids = std::vector<Vec3f>();
+
+	uint64_t source_size, source_hash; int64_t source_mtime;
+	if( !MeshCache::source_info( obj_file, source_size, source_mtime ) || !MeshCache::source_hash( obj_file, source_hash ) ){ return false; }
+
+	const std::string path = path_for(obj_file), temp_path = path + ".tmp";
+	std::ofstream out( temp_path, std::ios::binary | std::ios::trunc );
+	if( !out ){ return false; }
+
+	std::vector<Page> table( leaves.size() );
+	const uint64_t table_offset = sizeof(Header);
+	uint64_t written = 0;
+	auto pad_to = [&]( uint64_t offset ){
+		static const char zeros[page_alignment] = {};
+		out.write( zeros, std::streamsize(offset - written) );
+		written = offset;
+	};
+	auto put = [&]( const void *data, size_t bytes ){
+		out.write( static_cast<const char*>(data), std::streamsize(bytes) );
+		written += bytes;
+	};
+
+	// Header and table go first, the table is rewritten once it's filled in
+	Header h = {};
+	std::memcpy( h.magic, magic, sizeof(magic) );
+	h.version = version;
+	h.num_pages = uint32_t(leaves.size());
+	h.source_size = source_size;
+	h.source_mtime = source_mtime;
+	h.source_hash = source_hash;
+	h.table_offset = table_offset;
+	put( &h, sizeof(h) );
+	put( table.data(), table.size() * sizeof(Page) );
+
+	// Global vertex -> local vertex of the page being written
+	std::vector<uint32_t> local( mesh.num_vertices, std::numeric_limits<uint32_t>::max() );
+	std::vector<uint32_t> used, indices;
+	std::vector<Vec3f> attribute;
+	for( size_t l = 0; l < leaves.size(); ++l ){
+		const auto [begin, end] = leaves[l];
+		used.clear(); indices.clear();
+		for( size_t i = begin; i < end; ++i ){
+			const Vec3i &face = mesh.faces[order[i]];
+			for( int k = 0; k < 3; ++k ){
+				uint32_t &id = local[face[k]];
+				if( id == std::numeric_limits<uint32_t>::max() ){ id = uint32_t(used.size()); used.push_back( uint32_t(face[k]) ); }
+				indices.push_back( id );
+			}
+		}
+
+		Page &page = table[l];
+		const Vec3f &first = mesh.vertex(used[0]);
+		for( int k = 0; k < 3; ++k ){ page.bounds_min[k] = page.bounds_max[k] = first[k]; }
+		for( uint32_t v : used ){
+			for( int k = 0; k < 3; ++k ){
+				page.bounds_min[k] = std::min( page.bounds_min[k], mesh.vertex(v)[k] );
+				page.bounds_max[k] = std::max( page.bounds_max[k], mesh.vertex(v)[k] );
+			}
+		}
+		page.num_vertices = uint32_t(used.size());
+		page.num_triangles = uint32_t(end - begin);
+		page.bytes = uint64_t(used.size()) * 3 * sizeof(Vec3f) + indices.size() * sizeof(uint32_t);
+
+		pad_to( (written + page_alignment - 1) & ~uint64_t(page_alignment - 1) );
+		page.offset = written;
+		for( const Vec3f& (MeshArrays::*source)( size_t ) const : { &MeshArrays::vertex, &MeshArrays::normal, &MeshArrays::color } ){
+			attribute.clear();
+			for( uint32_t v : used ){ attribute.push_back( (mesh.*source)( v ) ); }
+			put( attribute.data(), attribute.size() * sizeof(Vec3f) );
+		}
+		put( indices.data(), indices.size() * sizeof(uint32_t) );
+
+		for( uint32_t v : used ){ local[v] = std::numeric_limits<uint32_t>::max(); }
+	}
+
+	out.seekp( std::streamoff(table_offset) );
+	out.write( reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(Page)) );
+	out.close();
+	if( !out ){ std::filesystem::remove( temp_path ); return false; }
+
+	std::error_code ec;
+	std::filesystem::rename( temp_path, path, ec );
+	if( ec ){ std::filesystem::remove( temp_path, ec ); return false; }
+
+	std::cout << "Wrote " << leaves.size() << " mesh pages to " << path << std::endl;
+	return true;
+}
+
+bool MeshPager::build_from_obj( const std::string &obj_file, const ObjLoadOptions &options, uint32_t target_triangles, size_t memory_budget )
+{
+	using namespace obj_detail;
+	using pages_detail::PositionColor;
+	using pages_detail::ScratchFile;
+	using pages_detail::SplitNode;
+
+	MappedFile obj;
+	if( !obj.open( obj_file ) ){ std::cerr << "\n**MeshPager Error: Could not open file " << obj_file << std::endl; return false; }
+	uint64_t source_size, source_hash; int64_t source_mtime;
+	if( !MeshCache::source_info( obj_file, source_size, source_mtime ) || !MeshCache::source_hash( obj_file, source_hash ) ){ return false; }
+	target_triangles = std::max<uint32_t>( target_triangles, 1 );
+	std::cout << "Building mesh pages for " << obj_file << " from the OBJ" << std::endl;
+
+	//
+	//	One pass over the file, the records go to scratch files
+	//
+	const std::string path = path_for(obj_file), temp_path = path + ".tmp";
+	ScratchFile positions( temp_path + ".v" ), normal_records( temp_path + ".vn" ), triangles( temp_path + ".f" ), polygon_starts( temp_path + ".fp" );
+	size_t nv = 0, nn = 0, nt = 0;
+	bool bare_corners = false;
+	std::vector<Corner> corners;
+	for( const char *p = obj.begin(); p < obj.end(); ){
+		const char *le = find_line_end( p, obj.end() ), *q = p;
+		const char *bad = nullptr;
+		switch( classify( q, le ) ){
+			case Record::vertex: {
+				PositionColor v;
+				float x, y, z, r, g, b;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ bad = p; break; }
+				v.position = Vec3f(x,y,z);
+				v.color = (q = parse_float(q, le, r)) && (q = parse_float(q, le, g)) && (q = parse_float(q, le, b)) ? Vec3f(r,g,b) : Vec3f(0.3f,0.3f,0.3f);
+				positions.put( v );
+				++nv;
+				break;
+			}
+			case Record::normal: {
+				float x, y, z;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ bad = p; break; }
+				normal_records.put( Vec3f(x,y,z) );
+				++nn;
+				break;
+			}
+			case Record::face: {
+				// Fanned around the first corner, like parse_records
+				const char *fe = strip_comment( q, le );
+				corners.clear();
+				for( q = skip_space(q, fe); q < fe; q = skip_space(q, fe) ){
+					Corner c;
+					if( !(q = parse_corner(q, fe, nv, nn, c)) ){ bad = p; break; }
+					bare_corners |= c.n < 0;
+					corners.push_back( c );
+				}
+				if( !bad && corners.size() < 3 ){ bad = p; }
+				for( size_t k = 2; !bad && k < corners.size(); ++k ){
+					triangles.put( corners[0] ); triangles.put( corners[k-1] ); triangles.put( corners[k] );
+					polygon_starts.put( uint8_t(k == 2) );
+					++nt;
+				}
+				break;
+			}
+			case Record::none: break;
+		}
+		if( bad ){
+			std::cerr << "\n**MeshPager Error: Malformed line " << line_number(obj.begin(), bad) << " in " << obj_file << std::endl;
+			return false;
+		}
+		p = le + 1;
+	}
+	obj.close();
+	if( nt == 0 ){ return false; }
+	if( !positions.finish() || !normal_records.finish() || !triangles.finish() || !polygon_starts.finish() ){
+		std::cerr << "\n**MeshPager Error: Could not write scratch files next to " << path << std::endl;
+		return false;
+	}
+	const PositionColor *vertex_records = positions.data<PositionColor>();
+	const Vec3f *normal_data = normal_records.data<Vec3f>();
+	const Corner *triangle_corners = triangles.data<Corner>();
+	const uint8_t *starts_polygon = polygon_starts.data<uint8_t>();
+	auto position = [&]( size_t v ) -> const Vec3f& { return vertex_records[v].position; };
+
+	// Same normal rule as load_obj: from the file only if every corner names one
+	const bool corner_normals = !bare_corners;
+	if( !corner_normals && nn > 0 ){ std::cout << "**Warning: not every face corner has a normal, ignoring the loaded ones." << std::endl; }
+
+	//
+	//	Check the indices and write the centroids
+	//
+	ScratchFile centroid_records( temp_path + ".c" );
+	const float big = std::numeric_limits<float>::max();
+	Vec3f lo( big, big, big ), hi( -big, -big, -big );
+	for( size_t t = 0; t < nt; ++t ){
+		const Corner *c = triangle_corners + t * 3;
+		Vec3f centroid;
+		for( int k = 0; k < 3; ++k ){
+			if( c[k].v < 0 || size_t(c[k].v) >= nv || c[k].n >= int(nn) ){
+				std::cerr << "\n**MeshPager Error: Face index out of range in " << obj_file << std::endl;
+				return false;
+			}
+			centroid += position( size_t(c[k].v) );
+		}
+		centroid *= 1.f / 3.f;
+		for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], centroid[k] ); hi[k] = std::max( hi[k], centroid[k] ); }
+		centroid_records.put( centroid );
+	}
+	if( !centroid_records.finish() ){ return false; }
+	const Vec3f *centroids = centroid_records.data<Vec3f>();
+
+	//
+	//	Without normals in the file they're made the way need_normals would. Welded
+	//	vertices sum over their position, a range of positions per pass over the
+	//	triangles. Unwelded ones sum over the triangles their polygon was fanned into.
+	//
+	ScratchFile made_normals( temp_path + ".n" );
+	if( !corner_normals && !options.weld_vertices ){
+		std::vector<Vec3f> sums, weighted;
+		for( size_t t = 0; t < nt; ){
+			size_t end = t + 1;
+			while( end < nt && !starts_polygon[end] ){ ++end; }
+
+			// Triangle t + i has the polygon's corners 0, i + 1 and i + 2
+			sums.assign( end - t + 2, Vec3f() );
+			weighted.resize( (end - t) * 3 );
+			for( size_t i = 0; i < end - t; ++i ){
+				const Corner *c = triangle_corners + (t + i) * 3;
+				const Vec3i face( c[0].v, c[1].v, c[2].v );
+				normals_detail::weighted_face_normals( &face, 0, 1, position, weighted.data() + i * 3 );
+				sums[0] += weighted[i*3]; sums[i+1] += weighted[i*3+1]; sums[i+2] += weighted[i*3+2];
+			}
+			normals_detail::normalize_normals( 0, sums.size(), [&]( size_t i ){ return sums[i]; }, [&]( size_t i ) -> Vec3f& { return sums[i]; } );
+			for( size_t i = 0; i < end - t; ++i ){ made_normals.put( sums[0] ); made_normals.put( sums[i+1] ); made_normals.put( sums[i+2] ); }
+			t = end;
+		}
+	}
+	if( !corner_normals && options.weld_vertices ){
+		const size_t batch = std::max<size_t>( 1, memory_budget / sizeof(Vec3f) );
+		std::vector<Vec3f> sums;
+		for( size_t first = 0; first < nv; first += batch ){
+			const size_t end = std::min( nv, first + batch );
+			sums.assign( end - first, Vec3f() );
+			for( size_t t = 0; t < nt; ++t ){
+				const Corner *c = triangle_corners + t * 3;
+				const Vec3i face( c[0].v, c[1].v, c[2].v );
+				Vec3f weighted[3];
+				normals_detail::weighted_face_normals( &face, 0, 1, position, weighted );
+				for( int k = 0; k < 3; ++k ){
+					if( size_t(face[k]) >= first && size_t(face[k]) < end ){ sums[ size_t(face[k]) - first ] += weighted[k]; }
+				}
+			}
+			normals_detail::normalize_normals( 0, sums.size(), [&]( size_t i ){ return sums[i]; }, [&]( size_t i ) -> Vec3f& { return sums[i]; } );
+			for( const Vec3f &n : sums ){ made_normals.put( n ); }
+		}
+	}
+	if( !made_normals.finish() ){ return false; }
+	const Vec3f *made_normal_data = made_normals.data<Vec3f>();
+
+	//
+	//	Split the centroids until every leaf holds at most target_triangles,
+	//	all leaves that are too big are split in the same pass over the centroids
+	//
+	std::vector<SplitNode> nodes( 1 );
+	nodes[0].lo = lo; nodes[0].hi = hi; nodes[0].count = nt;
+	for(;;){
+		std::vector<uint32_t> splitting, slot( nodes.size(), std::numeric_limits<uint32_t>::max() );
+		for( uint32_t i = 0; i < nodes.size(); ++i ){
+			if( nodes[i].axis < 0 && !nodes[i].done && nodes[i].count > target_triangles ){ slot[i] = uint32_t(splitting.size()); splitting.push_back( i ); }
+		}
+		if( splitting.empty() ){ break; }
+
+		std::vector<int> axes( splitting.size(), 0 );
+		for( size_t s = 0; s < splitting.size(); ++s ){
+			const SplitNode &n = nodes[splitting[s]];
+			for( int k = 1; k < 3; ++k ){ if( n.hi[k] - n.lo[k] > n.hi[axes[s]] - n.lo[axes[s]] ){ axes[s] = k; } }
+		}
+		std::vector<uint64_t> histograms( splitting.size() * pages_detail::split_bins, 0 );
+		std::vector<Vec3f> exact_lo( splitting.size(), hi ), exact_hi( splitting.size(), lo );
+		for( size_t t = 0; t < nt; ++t ){
+			const Vec3f &c = centroids[t];
+			const uint32_t s = slot[ pages_detail::find_leaf( nodes, c ) ];
+			if( s == std::numeric_limits<uint32_t>::max() ){ continue; }
+			++histograms[ s * pages_detail::split_bins + pages_detail::split_bin_of( nodes[splitting[s]], axes[s], c[axes[s]] ) ];
+			for( int k = 0; k < 3; ++k ){ exact_lo[s][k] = std::min( exact_lo[s][k], c[k] ); exact_hi[s][k] = std::max( exact_hi[s][k], c[k] ); }
+		}
+
+		for( size_t s = 0; s < splitting.size(); ++s ){
+			// The bin boundary closest to the median that leaves both sides something
+			const uint32_t i = splitting[s];
+			const uint64_t *histogram = histograms.data() + s * pages_detail::split_bins;
+			uint64_t below = 0, best_left = 0;
+			uint32_t best_bin = pages_detail::split_bins;
+			for( uint32_t b = 0; b + 1 < pages_detail::split_bins; ++b ){
+				below += histogram[b];
+				if( below == 0 || below == nodes[i].count ){ continue; }
+				const uint64_t off = below > nodes[i].count / 2 ? below - nodes[i].count / 2 : nodes[i].count / 2 - below;
+				const uint64_t best_off = best_left > nodes[i].count / 2 ? best_left - nodes[i].count / 2 : nodes[i].count / 2 - best_left;
+				if( best_bin == pages_detail::split_bins || off < best_off ){ best_bin = b; best_left = below; }
+			}
+
+			// Everything fell in one bin, zoom in on where the centroids really are. A leaf
+			// that doesn't get any smaller that way can't be split and becomes one big page.
+			if( best_bin == pages_detail::split_bins ){
+				SplitNode &n = nodes[i];
+				if( std::memcmp( n.lo.data, exact_lo[s].data, sizeof(Vec3f) ) == 0 && std::memcmp( n.hi.data, exact_hi[s].data, sizeof(Vec3f) ) == 0 ){ n.done = true; }
+				n.lo = exact_lo[s]; n.hi = exact_hi[s];
+				continue;
+			}
+
+			SplitNode left, right;
+			left.lo = right.lo = nodes[i].lo;
+			left.hi = right.hi = nodes[i].hi;
+			const float cut = nodes[i].lo[axes[s]] + (nodes[i].hi[axes[s]] - nodes[i].lo[axes[s]]) * float(best_bin + 1) / float(pages_detail::split_bins);
+			left.hi[axes[s]] = right.lo[axes[s]] = cut;
+			left.count = best_left;
+			right.count = nodes[i].count - best_left;
+			nodes[i].axis = axes[s];
+			nodes[i].split_bin = best_bin;
+			nodes[i].child = uint32_t(nodes.size());
+			nodes.push_back( left );
+			nodes.push_back( right );
+		}
+	}
+
+	// Pages in depth first order, so neighbours in the file are neighbours in space
+	std::vector<uint32_t> leaves, stack = { 0 };
+	while( !stack.empty() ){
+		const uint32_t i = stack.back();
+		stack.pop_back();
+		if( nodes[i].axis < 0 ){ nodes[i].page = uint32_t(leaves.size()); leaves.push_back( i ); continue; }
+		stack.push_back( nodes[i].child + 1 );
+		stack.push_back( nodes[i].child );
+	}
+
+	//
+	//	Write the pages, gathering as many as fit the budget per pass over the triangles
+	//
+	std::ofstream out( temp_path, std::ios::binary | std::ios::trunc );
+	if( !out ){ return false; }
+
+	std::vector<Page> table( leaves.size() );
+	const uint64_t table_offset = sizeof(Header);
+	uint64_t written = 0;
+	auto pad_to = [&]( uint64_t offset ){
+		static const char zeros[page_alignment] = {};
+		out.write( zeros, std::streamsize(offset - written) );
+		written = offset;
+	};
+	auto put = [&]( const void *data, size_t bytes ){
+		out.write( static_cast<const char*>(data), std::streamsize(bytes) );
+		written += bytes;
+	};
+
+	Header h = {};
+	std::memcpy( h.magic, magic, sizeof(magic) );
+	h.version = version;
+	h.num_pages = uint32_t(leaves.size());
+	h.source_size = source_size;
+	h.source_mtime = source_mtime;
+	h.source_hash = source_hash;
+	h.table_offset = table_offset;
+	put( &h, sizeof(h) );
+	put( table.data(), table.size() * sizeof(Page) );
+
+	// Triangles of the pages in a batch, and the corner (global triangle * 3 + k) behind each page vertex
+	const size_t triangle_budget = std::max<size_t>( 1, memory_budget / sizeof(uint64_t) );
+	std::vector<uint64_t> gathered, starts, vertex_corners;
+	std::vector<uint32_t> indices;
+	std::vector<Vec3f> attribute;
+	for( size_t first = 0; first < leaves.size(); ){
+		// Pages [first,end) of this batch, at least one however big it is
+		size_t end = first, batch_triangles = 0;
+		while( end < leaves.size() && ( end == first || batch_triangles + nodes[leaves[end]].count <= triangle_budget ) ){ batch_triangles += nodes[leaves[end++]].count; }
+
+		starts.assign( end - first + 1, 0 );
+		for( size_t l = first; l < end; ++l ){ starts[l - first + 1] = starts[l - first] + nodes[leaves[l]].count; }
+		std::vector<uint64_t> cursor( starts.begin(), starts.end() - 1 );
+		gathered.resize( batch_triangles );
+		for( size_t t = 0; t < nt; ++t ){
+			const uint32_t page = nodes[ pages_detail::find_leaf( nodes, centroids[t] ) ].page;
+			if( page >= first && page < end ){ gathered[ cursor[page - first]++ ] = t; }
+		}
+
+		for( size_t l = first; l < end; ++l ){
+			const uint64_t *page_triangles = gathered.data() + starts[l - first];
+			const size_t nc = size_t( starts[l - first + 1] - starts[l - first] ) * 3;
+			auto corner = [&]( size_t i ) -> const Corner& { return triangle_corners[ page_triangles[i / 3] * 3 + i % 3 ]; };
+
+			// Weld within the page by the same key as load_obj
+			vertex_corners.clear(); indices.resize( nc );
+			if( options.weld_vertices ){
+				CornerMap map( nc );
+				for( size_t i = 0; i < nc; ++i ){
+					Corner key = corner( i );
+					if( !corner_normals ){ key.n = -1; }
+					indices[i] = map.find_or_insert( key, uint32_t(vertex_corners.size()) );
+					if( indices[i] == vertex_corners.size() ){ vertex_corners.push_back( page_triangles[i / 3] * 3 + i % 3 ); }
+				}
+			} else {
+				for( size_t i = 0; i < nc; ++i ){ indices[i] = uint32_t(i); vertex_corners.push_back( page_triangles[i / 3] * 3 + i % 3 ); }
+			}
+
+			Page &page = table[l];
+			const Vec3f &first_position = position( size_t(triangle_corners[vertex_corners[0]].v) );
+			for( int k = 0; k < 3; ++k ){ page.bounds_min[k] = page.bounds_max[k] = first_position[k]; }
+			for( uint64_t c : vertex_corners ){
+				const Vec3f &p = position( size_t(triangle_corners[c].v) );
+				for( int k = 0; k < 3; ++k ){
+					page.bounds_min[k] = std::min( page.bounds_min[k], p[k] );
+					page.bounds_max[k] = std::max( page.bounds_max[k], p[k] );
+				}
+			}
+			page.num_vertices = uint32_t(vertex_corners.size());
+			page.num_triangles = uint32_t(nc / 3);
+			page.bytes = uint64_t(vertex_corners.size()) * 3 * sizeof(Vec3f) + indices.size() * sizeof(uint32_t);
+
+			pad_to( (written + page_alignment - 1) & ~uint64_t(page_alignment - 1) );
+			page.offset = written;
+
+			attribute.clear();
+			for( uint64_t c : vertex_corners ){ attribute.push_back( position( size_t(triangle_corners[c].v) ) ); }
+			put( attribute.data(), attribute.size() * sizeof(Vec3f) );
+
+			attribute.clear();
+			for( uint64_t c : vertex_corners ){
+				if( corner_normals ){ attribute.push_back( normal_data[triangle_corners[c].n] ); }
+				else if( options.weld_vertices ){ attribute.push_back( made_normal_data[triangle_corners[c].v] ); }
+				else { attribute.push_back( made_normal_data[c] ); }
+			}
+			put( attribute.data(), attribute.size() * sizeof(Vec3f) );
+
+			attribute.clear();
+			for( uint64_t c : vertex_corners ){ attribute.push_back( vertex_records[triangle_corners[c].v].color ); }
+			put( attribute.data(), attribute.size() * sizeof(Vec3f) );
+			put( indices.data(), indices.size() * sizeof(uint32_t) );
+		}
+		first = end;
+	}
+
+	out.seekp( std::streamoff(table_offset) );
+	out.write( reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(Page)) );
+	out.close();
+	if( !out ){ std::filesystem::remove( temp_path ); return false; }
+
+	std::error_code ec;
+	std::filesystem::rename( temp_path, path, ec );
+	if( ec ){ std::filesystem::remove( temp_path, ec ); return false; }
+
+	std::cout << "Wrote " << leaves.size() << " mesh pages to " << path << std::endl;
+	return true;
+}
+
+bool MeshPager::open( const std::string &obj_file, const MeshPagerOptions &options )
+{
+	close();
+	opts = options;
+
+	if( !std::filesystem::exists( obj_file ) || !mapped.open( path_for(obj_file) ) || mapped.size() < sizeof(Header) ){ close(); return false; }
+
+	Header h;
+	std::memcpy( &h, mapped.data(), sizeof(h) );
+	if( std::memcmp( h.magic, magic, sizeof(magic) ) != 0 || h.version != version ||
+		h.table_offset > mapped.size() || h.num_pages > (mapped.size() - h.table_offset) / sizeof(Page) ){
+		close();
+		return false;
+	}
+
+	// Stale the same way a MeshCache is, a touched but unchanged OBJ keeps its pages
+	if( !MeshCache::source_current( obj_file, h.source_size, h.source_mtime, h.source_hash ) ){
+		std::cout << "Mesh pages for " << obj_file << " are stale" << std::endl;
+		close();
+		return false;
+	}
+
+	// Every page has to lie inside the file and hold exactly what its counts say,
+	// PageData reads the indices right after the three attribute arrays
+	page_table.resize( h.num_pages );
+	std::memcpy( page_table.data(), mapped.data() + h.table_offset, h.num_pages * sizeof(Page) );
+	for( const Page &p : page_table ){
+		const uint64_t expected = uint64_t(p.num_vertices) * 3 * sizeof(Vec3f) + uint64_t(p.num_triangles) * 3 * sizeof(uint32_t);
+		if( p.offset > mapped.size() || p.bytes > mapped.size() - p.offset || p.bytes != expected ){ close(); return false; }
+	}
+	state.assign( page_table.size(), State::unloaded );
+	last_wanted.assign( page_table.size(), 0 );
+
+	stopping = false;
+	loader = std::thread( [this](){ load_pages(); } );
+
+	std::cout << "\nOpened " << page_table.size() << " mesh pages from " << path_for(obj_file) << std::endl;
+	return true;
+}
+
+void MeshPager::close()
+{
+	{
+		std::lock_guard<std::mutex> lock( queue_mutex );
+		stopping = true;
+		requests.clear();
+	}
+	queue_cv.notify_all();
+	if( loader.joinable() ){ loader.join(); }
+
+	completed.clear();
+	rejected.clear();
+	page_table.clear();
+	state.clear();
+	last_wanted.clear();
+	evicted_pages.clear();
+	used_bytes = 0;
+	mapped.close();
+}
+
+void MeshPager::update( const Vec3f &eye, const Vec3f &view_dir )
+{
+	++frame;
+	Vec3f dir = view_dir;
+	dir.normalize();
+	const Vec3f ahead = Vec3f( eye[0] + dir[0] * opts.prefetch_distance, eye[1] + dir[1] * opts.prefetch_distance, eye[2] + dir[2] * opts.prefetch_distance );
+	const float r2 = opts.resident_radius * opts.resident_radius;
+
+	// Everything near the eye or the prefetch point, nearest first
+	std::vector<std::pair<float,uint32_t>> wanted;
+	for( uint32_t p = 0; p < page_table.size(); ++p ){
+		const float d_eye = distance2( page_table[p], eye );
+		const float d_ahead = distance2( page_table[p], ahead );
+		if( d_eye <= r2 || d_ahead <= r2 ){
+			wanted.push_back( { std::min( d_eye, d_ahead ), p } );
+			last_wanted[p] = frame;
+		}
+	}
+	std::sort( wanted.begin(), wanted.end() );
+
+	std::vector<uint32_t> new_requests;
+	for( const auto &[d2, p] : wanted ){
+		if( state[p] != State::unloaded ){ continue; }
+
+		// Make room by evicting the least recently wanted pages we aren't using now
+		while( used_bytes + page_table[p].bytes > opts.budget_bytes ){
+			uint32_t victim = std::numeric_limits<uint32_t>::max();
+			for( uint32_t q = 0; q < page_table.size(); ++q ){
+				if( state[q] == State::resident && last_wanted[q] != frame &&
+					(victim == std::numeric_limits<uint32_t>::max() || last_wanted[q] < last_wanted[victim]) ){ victim = q; }
+			}
+			if( victim == std::numeric_limits<uint32_t>::max() ){ break; }
+			state[victim] = State::unloaded;
+			used_bytes -= page_table[victim].bytes;
+			evicted_pages.push_back( victim );
+		}
+		if( used_bytes + page_table[p].bytes > opts.budget_bytes ){ break; } // the rest is farther away anyway
+
+		state[p] = State::loading;
+		used_bytes += page_table[p].bytes;
+		new_requests.push_back( p );
+	}
+
+	if( !new_requests.empty() ){
+		std::lock_guard<std::mutex> lock( queue_mutex );
+		requests.insert( requests.end(), new_requests.begin(), new_requests.end() );
+		queue_cv.notify_one();
+	}
+}
+
+void MeshPager::take_loaded( std::vector<PageData> &loaded )
+{
+	loaded.clear();
+	std::vector<uint32_t> broken;
+	{
+		std::lock_guard<std::mutex> lock( queue_mutex );
+		loaded.swap( completed );
+		broken.swap( rejected );
+	}
+	for( const PageData &d : loaded ){ state[d.page] = State::resident; }
+
+	// Never asked for again, the rest of the mesh still draws
+	for( uint32_t p : broken ){
+		std::cerr << "Mesh page " << p << " has indices outside its vertices, skipping it" << std::endl;
+		state[p] = State::broken;
+		used_bytes -= page_table[p].bytes;
+	}
+}
+
+void MeshPager::load_pages()
+{
+	for(;;){
+		uint32_t p;
+		{
+			std::unique_lock<std::mutex> lock( queue_mutex );
+			queue_cv.wait( lock, [this](){ return stopping || !requests.empty(); } );
+			if( stopping ){ return; }
+			p = requests.front();
+			requests.pop_front();
+		}
+
+		// Page faults happen here, not on the render thread
+		const Page &page = page_table[p];
+		PageData data;
+		data.page = p;
+		data.num_vertices = page.num_vertices;
+		data.num_triangles = page.num_triangles;
+		data.bytes.assign( mapped.data() + page.offset, mapped.data() + page.offset + page.bytes );
+
+		// The sizes were checked by open(), the indices are checked here before anything uploads them
+		const bool in_range = MeshCache::indices_in_range( data.indices(), size_t(data.num_triangles) * 3, data.num_vertices );
+
+		std::lock_guard<std::mutex> lock( queue_mutex );
+		if( in_range ){ completed.push_back( std::move(data) ); }
+		else{ rejected.push_back( p ); }
+	}
+}
+
+#endif
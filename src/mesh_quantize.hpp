@@ -0,0 +1,152 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_QUANTIZE_HPP
+#define MESH_QUANTIZE_HPP 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Compact vertex format for the GPU
+//
+//	A Vertex is 36 bytes of floats, a QuantizedVertex is 16:
+//	- position, 3 x 16 bit unsigned normalized, relative to the mesh's
+//	  bounding box (offset + value * scale gives the position back)
+//	- normal, 2 x 16 bit signed normalized, octahedral encoded
+//	- color, RGBA8 unsigned normalized
+//
+//	Positions take 6 bytes, the 2 after them are padding so the normal
+//	and color start 4 byte aligned, as vertex attributes should. A mesh
+//	with one color for every vertex doesn't need the color, it's quantized
+//	into 12 byte QuantizedUncoloredVertex instead.
+//	shader.vert undoes all of it, see position_offset, position_scale
+//	and octahedral_normals there.
+//
+//	Example use:
+//	QuantizedVertices quantized;
+//	quantize_vertices( mesh.arrays(), quantized );
+//	glBufferData( GL_ARRAY_BUFFER, quantized.vertices.size() * sizeof(QuantizedVertex), quantized.vertices.data(), GL_STATIC_DRAW );
+//
+struct QuantizedVertex {
+	uint16_t position[4];	// xyz, w is padding
+	int16_t normal[2];
+	uint8_t color[4];		// rgb, a is always 255
+};
+static_assert( sizeof(QuantizedVertex) == 16, "QuantizedVertex must be tightly packed" );
+
+struct QuantizedUncoloredVertex {
+	uint16_t position[4];	// xyz, w is padding
+	int16_t normal[2];
+};
+static_assert( sizeof(QuantizedUncoloredVertex) == 12, "QuantizedUncoloredVertex must be tightly packed" );
+
+template <class V>
+struct QuantizedArray {
+	Vec3f offset;	// bounding box minimum
+	Vec3f scale;	// bounding box extent
+	std::vector<V> vertices;
+};
+using QuantizedVertices = QuantizedArray<QuantizedVertex>;
+using QuantizedUncoloredVertices = QuantizedArray<QuantizedUncoloredVertex>;
+
+// Octahedral encoding of a unit vector into two snorm16 values, and back
+static inline void octahedral_encode( const Vec3f &n, int16_t out[2] );
+static inline Vec3f octahedral_decode( const int16_t in[2] );
+
+// Quantizes every vertex of the mesh (either layout), the mesh needs normals.
+// Uncolored vertices leave the color out, whatever the mesh has.
+template <class V>
+static inline void quantize_vertices( const MeshArrays &mesh, QuantizedArray<V> &out, unsigned threads = 0 );
+
+// Position of a quantized vertex
+template <class V>
+static inline Vec3f dequantize_position( const QuantizedArray<V> &q, const V &v );
+
+
+//
+//	Implementation
+//
+
+static inline void octahedral_encode( const Vec3f &n, int16_t out[2] )
+{
+	const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	float x = l1 > 0.f ? n[0] / l1 : 0.f;
+	float y = l1 > 0.f ? n[1] / l1 : 0.f;
+
+	// Fold the lower hemisphere over the diagonals
+	if( l1 > 0.f && n[2] < 0.f ){
+		const float fx = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+		const float fy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+		x = fx; y = fy;
+	}
+	out[0] = int16_t( std::lround( std::clamp( x, -1.f, 1.f ) * 32767.f ) );
+	out[1] = int16_t( std::lround( std::clamp( y, -1.f, 1.f ) * 32767.f ) );
+}
+
+static inline Vec3f octahedral_decode( const int16_t in[2] )
+{
+	// Same as shader.vert
+	Vec3f n( std::max( in[0] / 32767.f, -1.f ), std::max( in[1] / 32767.f, -1.f ), 0.f );
+	n[2] = 1.f - std::fabs(n[0]) - std::fabs(n[1]);
+	const float t = std::max( -n[2], 0.f );
+	n[0] += n[0] >= 0.f ? -t : t;
+	n[1] += n[1] >= 0.f ? -t : t;
+
+	// |x| + |y| + |z| is 1 here, so the length is never 0
+	n *= 1.f / std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+	return n;
+}
+
+template <class V>
+static inline void quantize_vertices( const MeshArrays &mesh, QuantizedArray<V> &out, unsigned threads )
+{
+	const size_t nv = mesh.num_vertices;
+	out.vertices.resize( nv );
+	out.offset = out.scale = Vec3f();
+	if( nv == 0 ){ return; }
+
+	Vec3f lo = mesh.vertex(0), hi = lo;
+	for( size_t i = 1; i < nv; ++i ){
+		const Vec3f &p = mesh.vertex(i);
+		for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], p[k] ); hi[k] = std::max( hi[k], p[k] ); }
+	}
+	out.offset = lo;
+	out.scale = hi - lo;
+	Vec3f to_unit;
+	for( int k = 0; k < 3; ++k ){ to_unit[k] = out.scale[k] > 0.f ? 65535.f / out.scale[k] : 0.f; }
+
+	auto to_unorm8 = []( float c ){ return uint8_t( std::lround( std::clamp( c, 0.f, 1.f ) * 255.f ) ); };
+	const bool has_normals = mesh.num_normals >= nv, has_colors = mesh.num_colors >= nv || mesh.num_colors == 0;
+	parallel_for( nv, threads, [&]( size_t begin, size_t end ){
+		for( size_t i = begin; i < end; ++i ){
+			V &q = out.vertices[i];
+			const Vec3f &p = mesh.vertex(i);
+			for( int k = 0; k < 3; ++k ){
+				q.position[k] = uint16_t( std::lround( std::clamp( (p[k] - lo[k]) * to_unit[k], 0.f, 65535.f ) ) );
+			}
+			q.position[3] = 0;
+			octahedral_encode( has_normals ? mesh.normal(i) : Vec3f(0.f, 0.f, 1.f), q.normal );
+			if constexpr( std::is_same_v<V, QuantizedVertex> ){
+				const Vec3f c = has_colors ? mesh.color(i) : mesh.constant_color;
+				q.color[0] = to_unorm8( c[0] ); q.color[1] = to_unorm8( c[1] ); q.color[2] = to_unorm8( c[2] );
+				q.color[3] = 255;
+			}
+		}
+	});
+}
+
+template <class V>
+static inline Vec3f dequantize_position( const QuantizedArray<V> &q, const V &v )
+{
+	Vec3f p;
+	for( int k = 0; k < 3; ++k ){ p[k] = q.offset[k] + float(v.position[k]) / 65535.f * q.scale[k]; }
+	return p;
+}
+
+#endif
@@ -0,0 +1,241 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_SPATIAL_SORT_HPP
+#define MESH_SPATIAL_SORT_HPP 1
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include "load_report.hpp"
+#include "mesh_optimize.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Morton order for CPU passes over a loaded mesh
+//
+//	spatial_sort_mesh() sorts the triangles by the Morton code of their
+//	centroids, 10 bits per axis inside the centroids' bounding box, so
+//	triangles that are close in space are close in 'faces'. The vertices
+//	are then renumbered in the order the sorted triangles first use them
+//	(optimize_vertex_fetch(), every attribute array moves together), so
+//	walking the faces walks the vertex arrays mostly front to back.
+//
+//	The keys are sorted with an LSD radix sort, 8 bits per pass. Every
+//	worker counts the digits of its own block of keys, and scatters them
+//	to offsets that put its block after the blocks before it, so each
+//	pass is stable and the result doesn't depend on the thread count.
+//
+//	The gain is measured as cache lines of vertex data fetched per triangle,
+//	walking the faces through an LRU-ish (FIFO) cache of cache_lines lines.
+//	Vertex cache order (optimize_mesh()) is for the GPU and undoes this one,
+//	run whichever matters for what comes next.
+//
+//	Example use:
+//	mesh.load_obj( obj, options );
+//	SpatialSortStats stats = spatial_sort_mesh( mesh );
+//	stats.print( std::cout );
+//
+
+struct SpatialSortOptions {
+	unsigned threads = 0;
+
+	// Cache the locality is measured against, 64 byte lines (512 is a 32 KB L1)
+	unsigned cache_lines = 512;
+};
+
+struct FetchLocality {
+	double lines_per_triangle = 0.0;	// vertex cache lines missed per triangle
+};
+
+struct SpatialSortStats {
+	FetchLocality before;
+	FetchLocality after;
+	double keys_ms = 0.0;	// centroids and Morton codes
+	double sort_ms = 0.0;	// radix sort
+	double remap_ms = 0.0;	// moving faces and vertices
+	double ms = 0.0;
+
+	// How many times fewer lines the sorted order misses
+	double gain() const { return after.lines_per_triangle > 0.0 ? before.lines_per_triangle / after.lines_per_triangle : 1.0; }
+
+	void print( std::ostream &out ) const
+	{
+		out << "Sorted mesh in Morton order in " << ms << " ms (keys " << keys_ms << ", sort " << sort_ms << ", remap " << remap_ms
+			<< " ms): cache lines per triangle " << before.lines_per_triangle << " -> " << after.lines_per_triangle
+			<< " (" << gain() << "x)" << std::endl;
+	}
+};
+
+// Interleaves the low 10 bits of x, y and z into a 30 bit Morton code
+static inline uint32_t morton_code( uint32_t x, uint32_t y, uint32_t z );
+
+// Sorts values by keys, stable, looking at the low key_bits bits of the keys only
+static inline void radix_sort( std::vector<uint32_t> &keys, std::vector<uint32_t> &values, unsigned key_bits = 32, unsigned threads = 0 );
+
+// Simulates a FIFO cache of 64 byte lines over the vertices the faces fetch
+static inline FetchLocality analyze_fetch_locality( const std::vector<Vec3i> &faces, size_t vertex_bytes, unsigned cache_lines = 512 );
+
+// Morton code of every face's centroid
+static inline void morton_keys( const MeshArrays &mesh, std::vector<uint32_t> &keys, unsigned threads = 0 );
+
+// Sorts the faces in Morton order and renumbers the vertices to match
+static inline SpatialSortStats spatial_sort_mesh( TriMesh &mesh, const SpatialSortOptions &options = SpatialSortOptions() );
+
+
+//
+//	Implementation
+//
+
+static inline uint32_t morton_code( uint32_t x, uint32_t y, uint32_t z )
+{
+	// Spreads 10 bits out to every third bit
+	auto spread = []( uint32_t v ){
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+static inline void radix_sort( std::vector<uint32_t> &keys, std::vector<uint32_t> &values, unsigned key_bits, unsigned threads )
+{
+	const size_t n = keys.size();
+	if( n < 2 ){ return; }
+	const size_t workers = std::max<size_t>( 1, std::min<size_t>( worker_count( threads ), n / 4096 ) );
+
+	std::vector<uint32_t> keys_out( n ), values_out( n );
+	std::vector<size_t> counts( workers * 256 );
+	for( unsigned shift = 0; shift < std::min( key_bits, 32u ); shift += 8 ){
+		// Digit histogram of every worker's block
+		std::fill( counts.begin(), counts.end(), size_t(0) );
+		parallel_tasks( workers, unsigned(workers), [&]( size_t w ){
+			size_t *count = &counts[w * 256];
+			for( size_t i = n * w / workers, end = n * (w+1) / workers; i < end; ++i ){ ++count[ (keys[i] >> shift) & 0xff ]; }
+		});
+
+		// Every key has the same digit, nothing moves
+		size_t biggest = 0;
+		for( unsigned d = 0; d < 256; ++d ){
+			size_t total = 0;
+			for( size_t w = 0; w < workers; ++w ){ total += counts[w * 256 + d]; }
+			biggest = std::max( biggest, total );
+		}
+		if( biggest == n ){ continue; }
+
+		// Offsets digit by digit, and worker by worker within a digit
+		size_t offset = 0;
+		for( unsigned d = 0; d < 256; ++d ){
+			for( size_t w = 0; w < workers; ++w ){
+				const size_t count = counts[w * 256 + d];
+				counts[w * 256 + d] = offset;
+				offset += count;
+			}
+		}
+
+		parallel_tasks( workers, unsigned(workers), [&]( size_t w ){
+			size_t *next = &counts[w * 256];
+			for( size_t i = n * w / workers, end = n * (w+1) / workers; i < end; ++i ){
+				const size_t to = next[ (keys[i] >> shift) & 0xff ]++;
+				keys_out[to] = keys[i];
+				values_out[to] = values[i];
+			}
+		});
+		keys.swap( keys_out );
+		values.swap( values_out );
+	}
+}
+
+static inline FetchLocality analyze_fetch_locality( const std::vector<Vec3i> &faces, size_t vertex_bytes, unsigned cache_lines )
+{
+	FetchLocality locality;
+	if( faces.empty() || vertex_bytes == 0 ){ return locality; }
+
+	size_t max_vertex = 0;
+	for( const Vec3i &f : faces ){ for( int k = 0; k < 3; ++k ){ max_vertex = std::max( max_vertex, size_t(f[k]) ); } }
+
+	// A line is cached if it came in less than cache_lines misses ago, as in analyze_vertex_cache()
+	std::vector<size_t> inserted( (max_vertex + 1) * vertex_bytes / 64 + 1, 0 );
+	size_t misses = 0;
+	for( const Vec3i &f : faces ){
+		for( int k = 0; k < 3; ++k ){
+			const size_t first = size_t(f[k]) * vertex_bytes / 64, last = (size_t(f[k]) * vertex_bytes + vertex_bytes - 1) / 64;
+			for( size_t line = first; line <= last; ++line ){
+				size_t &when = inserted[line];
+				if( when == 0 || misses - when >= cache_lines ){ when = ++misses; }
+			}
+		}
+	}
+	locality.lines_per_triangle = double(misses) / double(faces.size());
+	return locality;
+}
+
+static inline void morton_keys( const MeshArrays &mesh, std::vector<uint32_t> &keys, unsigned threads )
+{
+	const size_t nf = mesh.num_faces;
+	keys.resize( nf );
+	if( nf == 0 ){ return; }
+
+	// Centroids, kept as sums of the three corners, the scale doesn't matter
+	std::vector<Vec3f> centroids( nf );
+	parallel_for( nf, threads, [&]( size_t begin, size_t end ){
+		for( size_t f = begin; f < end; ++f ){
+			centroids[f] = mesh.vertex( mesh.faces[f][0] );
+			centroids[f] += mesh.vertex( mesh.faces[f][1] );
+			centroids[f] += mesh.vertex( mesh.faces[f][2] );
+		}
+	});
+
+	Vec3f lo = centroids[0], hi = lo;
+	for( const Vec3f &c : centroids ){
+		for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], c[k] ); hi[k] = std::max( hi[k], c[k] ); }
+	}
+	// One cell size for every axis keeps the curve from stretching along flat meshes
+	const float extent = std::max( { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] } );
+	const float to_grid = extent > 0.f ? 1023.f / extent : 0.f;
+
+	parallel_for( nf, threads, [&]( size_t begin, size_t end ){
+		for( size_t f = begin; f < end; ++f ){
+			uint32_t cell[3];
+			for( int k = 0; k < 3; ++k ){ cell[k] = uint32_t( std::clamp( (centroids[f][k] - lo[k]) * to_grid, 0.f, 1023.f ) ); }
+			keys[f] = morton_code( cell[0], cell[1], cell[2] );
+		}
+	});
+}
+
+static inline SpatialSortStats spatial_sort_mesh( TriMesh &mesh, const SpatialSortOptions &options )
+{
+	SpatialSortStats stats;
+	const size_t vertex_bytes = mesh.interleaved() ? sizeof(Vertex) : sizeof(Vec3f);
+	stats.before = analyze_fetch_locality( mesh.faces, vertex_bytes, options.cache_lines );
+
+	Stopwatch timer;
+	std::vector<uint32_t> keys, order( mesh.faces.size() );
+	morton_keys( mesh.arrays(), keys, options.threads );
+	stats.keys_ms = timer.lap();
+
+	std::iota( order.begin(), order.end(), 0u );
+	radix_sort( keys, order, 30, options.threads );
+	stats.sort_ms = timer.lap();
+
+	std::vector<Vec3i> sorted( order.size() );
+	parallel_for( order.size(), options.threads, [&]( size_t begin, size_t end ){
+		for( size_t t = begin; t < end; ++t ){ sorted[t] = mesh.faces[ order[t] ]; }
+	});
+	mesh.faces.swap( sorted );
+	optimize_vertex_fetch( mesh );
+	mesh.invalidate_adjacency();
+	stats.remap_ms = timer.lap();
+	stats.ms = stats.keys_ms + stats.sort_ms + stats.remap_ms;
+
+	stats.after = analyze_fetch_locality( mesh.faces, vertex_bytes, options.cache_lines );
+	return stats;
+}
+
+#endif
@@ -0,0 +1,359 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_STREAM_HPP
+#define MESH_STREAM_HPP 1
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "trimesh.hpp"
+
+//
+//	Progressive OBJ loading
+//
+//	A background thread parses the file front to back and fills a
+//	TriMesh whose arrays were sized up front from a counting pre-scan.
+//	Every batch_triangles triangles it publishes how many vertices and
+//	triangles are complete, so the render thread can upload that much
+//	and draw it while the rest is still being read.
+//
+//	Vertices are appended in the order faces first use them and faces
+//	only reference vertices that came before them, so any prefix of the
+//	arrays is drawable. Faces that reference vertices defined further
+//	down the file are held back and finished at the end.
+//
+//	Vertices are welded and given normals by the same rules as load_obj,
+//	so unless faces were held back the final mesh is the one load_obj
+//	makes. If some corner has no normal, a new vertex gets the normal of
+//	the face that added it while streaming.
+//
+//	Once all geometry is uploaded the render thread calls all_uploaded().
+//	The loader then trims the arrays, drops the colors if they're all the
+//	same and recomputes proper normals if it has to. It reorders them for
+//	ObjLoadOptions::optimize, interleaves them for ObjLoadOptions::interleave
+//	and writes the mesh cache before reporting finished(). Streamed arrays
+//	are always split, the render thread interleaves the ranges it uploads.
+//
+//	So the final mesh can differ from what was streamed in more than its
+//	normals, the render thread uploads it again as a whole. Only a mesh
+//	with varying colors loaded without optimize or interleave keeps its
+//	streamed layout, normals_recomputed() then says if its normals changed.
+//
+//	Example use:
+//	MeshStream stream;
+//	stream.start( obj, options, true );
+//	while( rendering ){
+//		if( stream.sized() ){ < upload up to ready_vertices()/ready_triangles() > }
+//		if( stream.geometry_done() && < everything uploaded > ){ stream.all_uploaded(); }
+//		if( stream.finished() ){ stream.join(); < upload mesh() again > }
+//	}
+//
+class MeshStream {
+public:
+	static constexpr size_t batch_triangles = size_t(1) << 15;
+
+	MeshStream() {}
+	~MeshStream(){ cancel(); join(); }
+
+	MeshStream( const MeshStream& ) = delete;
+	MeshStream& operator=( const MeshStream& ) = delete;
+
+	// Maps the file and starts the loader thread, returns false if the file can't be opened
+	inline bool start( const std::string &file, const ObjLoadOptions &options, bool write_cache );
+
+	// True once the arrays have their final capacity (they never move after that)
+	bool sized() const { return is_sized.load( std::memory_order_acquire ); }
+	size_t capacity_vertices() const { return max_vertices; }
+	size_t capacity_triangles() const { return max_triangles; }
+
+	// How much of mesh() is complete. Read the triangles first, they never run ahead of the vertices.
+	size_t ready_triangles() const { return num_ready_triangles.load( std::memory_order_acquire ); }
+	size_t ready_vertices() const { return num_ready_vertices.load( std::memory_order_acquire ); }
+
+	// Every vertex and triangle has been published
+	bool geometry_done() const { return is_geometry_done.load( std::memory_order_acquire ); }
+
+	// Tells the loader the render thread is done reading the arrays
+	inline void all_uploaded();
+
+	// The mesh is final, call join() before touching it
+	bool finished() const { return is_finished.load( std::memory_order_acquire ); }
+	bool failed() const { return has_failed.load( std::memory_order_acquire ); }
+	bool normals_recomputed() const { return recomputed_normals; }
+
+	void join(){ if( loader.joinable() ){ loader.join(); } }
+
+	// Arrays being filled, only read the published ranges until finished()
+	TriMesh& mesh(){ return streamed; }
+
+private:
+	std::string file_name;
+	ObjLoadOptions load_options;
+	bool cache_result = false;
+	MappedFile mapped;
+	TriMesh streamed;
+	std::thread loader;
+
+	size_t max_vertices = 0;
+	size_t max_triangles = 0;
+	bool recomputed_normals = false;
+
+	std::atomic<bool> is_sized{ false };
+	std::atomic<size_t> num_ready_vertices{ 0 };
+	std::atomic<size_t> num_ready_triangles{ 0 };
+	std::atomic<bool> is_geometry_done{ false };
+	std::atomic<bool> is_finished{ false };
+	std::atomic<bool> has_failed{ false };
+	std::atomic<bool> stop_requested{ false };
+
+	std::mutex upload_mutex;
+	std::condition_variable upload_cv;
+	bool uploaded = false;
+	bool cancelled = false;
+
+	void cancel()
+	{
+		stop_requested.store( true, std::memory_order_relaxed );
+		std::lock_guard<std::mutex> lock( upload_mutex );
+		cancelled = true;
+		upload_cv.notify_all();
+	}
+
+	inline void run();
+	inline bool stream_geometry( bool &provisional_normals );
+	void fail( const std::string &message )
+	{
+		std::cerr << "\n**MeshStream Error: " << message << " in " << file_name << std::endl;
+		has_failed.store( true, std::memory_order_release );
+		is_geometry_done.store( true, std::memory_order_release );
+		is_finished.store( true, std::memory_order_release );
+	}
+};
+
+
+//
+//	Implementation
+//
+
+bool MeshStream::start( const std::string &file, const ObjLoadOptions &options, bool write_cache )
+{
+	std::cout << "\nStreaming " << file << std::endl;
+	Stopwatch timer;
+	if( !mapped.open( file ) ){ std::cerr << "\n**MeshStream Error: Could not open file " << file << std::endl; return false; }
+	streamed.report = LoadReport();
+	streamed.report.file = file;
+	streamed.report.source = "stream";
+	streamed.report.threads = worker_count( options.threads );
+	streamed.report.bytes_read = mapped.size();
+	streamed.report.open_ms = timer.lap();
+	file_name = file;
+	load_options = options;
+	cache_result = write_cache;
+	loader = std::thread( [this](){ run(); } );
+	return true;
+}
+
+void MeshStream::all_uploaded()
+{
+	std::lock_guard<std::mutex> lock( upload_mutex );
+	uploaded = true;
+	upload_cv.notify_all();
+}
+
+void MeshStream::run()
+{
+	const int64_t rss_before = peak_rss_bytes();
+	bool provisional_normals = false;
+	if( !stream_geometry( provisional_normals ) ){ return; }
+
+	// Wait for the render thread to stop reading before changing the arrays
+	{
+		std::unique_lock<std::mutex> lock( upload_mutex );
+		upload_cv.wait( lock, [this](){ return uploaded || cancelled; } );
+		if( cancelled ){ return; }
+	}
+
+	const size_t nv = num_ready_vertices.load( std::memory_order_relaxed );
+	streamed.vertices.resize( nv );
+	streamed.colors.resize( nv );
+	streamed.normals.resize( nv );
+
+	// Colors had to be streamed per vertex, the final mesh only keeps them if they vary
+	streamed.compact_colors();
+
+	// Streamed face normals were only a stand-in, do it properly now
+	if( provisional_normals ){
+		streamed.need_normals( true );
+		recomputed_normals = true;
+	}
+	if( load_options.optimize ){
+		const MeshOptimizeStats stats = optimize_mesh( streamed );
+		stats.print( std::cout );
+		streamed.report.optimize_ms = stats.ms;
+	}
+	if( load_options.interleave ){ streamed.interleave(); }
+	streamed.report.vertices = nv;
+	streamed.report.faces = streamed.faces.size();
+	streamed.report.peak_rss_delta = peak_rss_bytes() - rss_before;
+
+	if( cache_result && !MeshCache::write( file_name, load_options, streamed.arrays() ) ){
+		std::cerr << "Could not write mesh cache " << MeshCache::path_for(file_name) << std::endl;
+	}
+	mapped.close();
+
+	is_finished.store( true, std::memory_order_release );
+}
+
+bool MeshStream::stream_geometry( bool &provisional_normals )
+{
+	using namespace obj_detail;
+	Stopwatch timer;
+
+	//
+	//	Counting pre-scan, this fixes the capacity of every array
+	//
+	const std::pmr::vector<const char*> bounds = split_lines( mapped.begin(), mapped.end(), worker_count(load_options.threads) );
+	std::vector<Counts> chunk_counts( bounds.size() - 1 );
+	parallel_tasks( chunk_counts.size(), load_options.threads, [&]( size_t k ){
+		chunk_counts[k] = count_records( bounds[k], bounds[k+1] );
+	});
+	Counts counts;
+	for( const Counts &c : chunk_counts ){ counts += c; }
+
+	std::vector<Vec3f> temp_verts( counts.verts ), temp_colors( counts.verts ), temp_normals( counts.normals );
+	max_vertices = counts.corners;
+	max_triangles = counts.triangles;
+	streamed.vertices.resize( max_vertices );
+	streamed.colors.resize( max_vertices );
+	streamed.normals.resize( max_vertices );
+	streamed.faces.resize( max_triangles );
+	streamed.report.prescan_ms = timer.lap();
+	is_sized.store( true, std::memory_order_release );
+
+	//
+	//	Parse in file order and publish every batch
+	//
+	// Same rule as load_obj: the file's normals are only used if every corner has
+	// one, otherwise corners are welded by position and normals are recomputed
+	const bool corner_normals = counts.corners > 0 && counts.bare_corners == 0;
+	const bool weld = load_options.weld_vertices;
+	CornerMap welded( weld ? counts.corners : 0 );
+	std::vector<Corner> face;
+	std::vector<int> face_ids;
+	struct Deferred { const char *line; size_t vi, ni; };
+	std::vector<Deferred> deferred;
+	size_t vi = 0, ni = 0, nv = 0, nt = 0, published = 0;
+
+	// Emits the face in 'face', all of its corners must already be defined
+	auto emit_face = [&](){
+		std::vector<int> &ids = face_ids;
+		ids.resize( face.size() );
+		const size_t first_new = nv;
+		for( size_t k = 0; k < face.size(); ++k ){
+			Corner key = face[k];
+			if( !corner_normals ){ key.n = -1; }
+			uint32_t id = uint32_t(nv);
+			if( weld ){ id = welded.find_or_insert( key, uint32_t(nv) ); }
+			if( id == nv ){
+				streamed.vertices[nv] = temp_verts[key.v];
+				streamed.colors[nv] = temp_colors[key.v];
+				if( corner_normals ){ streamed.normals[nv] = temp_normals[key.n]; }
+				++nv;
+			}
+			ids[k] = int(id);
+		}
+
+		// Stand-in normal until they are recomputed. Only the vertices this face
+		// added, the ones it shares may already be published and read by the render thread.
+		if( !corner_normals ){
+			const Vec3f &p0 = streamed.vertices[ids[0]], &p1 = streamed.vertices[ids[1]], &p2 = streamed.vertices[ids[2]];
+			Vec3f facenormal = (p0-p1).cross( p1-p2 );
+			facenormal.normalize();
+			for( size_t k = 0; k < face.size(); ++k ){
+				if( size_t(ids[k]) >= first_new ){ streamed.normals[ids[k]] = facenormal; }
+			}
+		}
+
+		for( size_t k = 2; k < face.size(); ++k ){ streamed.faces[nt++] = Vec3i( ids[0], ids[k-1], ids[k] ); }
+	};
+
+	auto publish = [&](){
+		num_ready_vertices.store( nv, std::memory_order_release );
+		num_ready_triangles.store( nt, std::memory_order_release );
+		published = nt;
+	};
+
+	const char *p = mapped.begin(), *end = mapped.end();
+	while( p < end ){
+		const char *le = find_line_end( p, end );
+		const char *q = p;
+		switch( classify( q, le ) ){
+			case Record::vertex: {
+				float x, y, z, cx, cy, cz;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ fail( "Malformed vertex" ); return false; }
+				temp_verts[vi] = Vec3f(x,y,z);
+				if( (q = parse_float(q, le, cx)) && (q = parse_float(q, le, cy)) && (q = parse_float(q, le, cz)) ){ temp_colors[vi] = Vec3f(cx,cy,cz); }
+				else { temp_colors[vi] = Vec3f(0.3f,0.3f,0.3f); }
+				++vi;
+				break;
+			}
+			case Record::normal: {
+				float x, y, z;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ fail( "Malformed normal" ); return false; }
+				temp_normals[ni++] = Vec3f(x,y,z);
+				break;
+			}
+			case Record::face: {
+				const char *fe = strip_comment( q, le );
+				bool ready = true;
+				face.clear();
+				for( q = skip_space(q, fe); q < fe; q = skip_space(q, fe) ){
+					Corner c;
+					if( !(q = parse_corner(q, fe, vi, ni, c)) || c.v < 0 || c.n >= int(counts.normals) ){ fail( "Malformed face" ); return false; }
+					if( size_t(c.v) >= vi || c.n >= int(ni) ){ ready = false; }
+					face.push_back( c );
+				}
+				if( face.size() < 3 ){ fail( "Malformed face" ); return false; }
+				if( ready ){ emit_face(); }
+				else { deferred.push_back( Deferred{ p, vi, ni } ); }
+				if( nt - published >= batch_triangles ){
+					if( stop_requested.load( std::memory_order_relaxed ) ){ return false; }
+					publish();
+				}
+				break;
+			}
+			case Record::none: break;
+		}
+		p = le + 1;
+	}
+
+	// Faces that referenced vertices further down, their relative
+	// indices were resolved when they were read, so keep those
+	for( const Deferred &d : deferred ){
+		const char *le = find_line_end( d.line, end );
+		const char *q = d.line;
+		classify( q, le );
+		const char *fe = strip_comment( q, le );
+		face.clear();
+		for( q = skip_space(q, fe); q < fe; q = skip_space(q, fe) ){
+			Corner c;
+			q = parse_corner( q, fe, d.vi, d.ni, c );
+			if( c.v < 0 || size_t(c.v) >= vi || c.n >= int(ni) ){ fail( "Face index out of range" ); return false; }
+			face.push_back( c );
+		}
+		emit_face();
+	}
+
+	publish();
+	streamed.report.parse_ms = timer.lap(); // resolving happens as faces are read
+	provisional_normals = !corner_normals;
+	is_geometry_done.store( true, std::memory_order_release );
+	return true;
+}
+
+#endif
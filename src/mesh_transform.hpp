@@ -0,0 +1,171 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESH_TRANSFORM_HPP
+#define MESH_TRANSFORM_HPP 1
+
+#include <cstddef>
+
+#include "core/Matrix.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Batch transforms of points and directions on the CPU
+//
+//	Everything here applies a GLmatrix the way the shaders do with it uploaded
+//	as it is (glUniformMatrix4fv, transpose GL_FALSE): entries 12-14 are the
+//	translation, so for a point (x, y, z, 1)
+//		x' = x * m[0] + y * m[4] + z * m[8] + m[12]
+//	and so on for y' (m[1], m[5]...), z' and w'. Directions have w = 0 and don't
+//	move. That's the transpose of operator*(Matrix, Vector3D), which multiplies
+//	M * v; use these for geometry that also goes through the shaders.
+//
+//	With perspective_divide x', y' and z' are divided by w' (points only).
+//	Points where w' is 0 come out as inf or nan, clip them first if it matters.
+//
+//	The data is either structure of arrays (x[], y[] and z[]) or positions
+//	'stride' bytes apart (TriMesh::vertices, or the positions in packed Vertex
+//	data). Outputs may be the inputs, for in place transforms, but may not
+//	overlap them otherwise. The arrays are cut into ranges, one per worker, each
+//	done 4 points at a time with SSE where there is SSE.
+//
+//	The matrix is composed (see Matrix.hpp) on the calling thread before the
+//	workers start, so the workers only ever read it.
+//
+//	Example use:
+//	transform_soa( model, xs, ys, zs, count, xs, ys, zs );	// in place
+//	transform_mesh_positions( mesh, model );
+//
+
+struct TransformOptions {
+	bool directions = false;			// w = 0, no translation (and no divide)
+	bool perspective_divide = false;	// x, y and z divided by w
+	unsigned threads = 0;
+
+	// Points per worker below which there's no point starting another one
+	size_t grain = size_t(1) << 16;
+};
+
+// Transforms count points (or directions) stored as three arrays. out_w, if given, gets w'.
+static inline void transform_soa( const GLmatrix &matrix, const float *x, const float *y, const float *z, size_t count,
+								  float *out_x, float *out_y, float *out_z, float *out_w = nullptr,
+								  const TransformOptions &options = TransformOptions() );
+
+// Transforms count points (or directions) of 3 floats, in_stride and out_stride bytes apart
+static inline void transform_strided( const GLmatrix &matrix, const float *in, size_t in_stride, size_t count,
+									  float *out, size_t out_stride, const TransformOptions &options = TransformOptions() );
+
+// Transforms the mesh's positions in place, either layout. Normals aren't touched,
+// recompute them (need_normals(true)) if the matrix rotates or scales.
+static inline void transform_mesh_positions( TriMesh &mesh, const GLmatrix &matrix, const TransformOptions &options = TransformOptions() );
+
+
+//
+//	Implementation
+//
+
+static inline void transform_soa( const GLmatrix &matrix, const float *x, const float *y, const float *z, size_t count,
+								  float *out_x, float *out_y, float *out_z, float *out_w, const TransformOptions &options )
+{
+	const float *m = matrix;	// composed here, before the workers read it
+	const float w = options.directions ? 0.f : 1.f;
+	const bool divide = options.perspective_divide && !options.directions;
+	const bool need_w = divide || out_w != nullptr;
+
+	parallel_for( count, options.threads, [&]( size_t begin, size_t end ){
+		size_t i = begin;
+#if MATRIX_SSE
+		const __m128 m0 = _mm_set1_ps( m[0] ), m1 = _mm_set1_ps( m[1] ), m2 = _mm_set1_ps( m[2] ), m3 = _mm_set1_ps( m[3] );
+		const __m128 m4 = _mm_set1_ps( m[4] ), m5 = _mm_set1_ps( m[5] ), m6 = _mm_set1_ps( m[6] ), m7 = _mm_set1_ps( m[7] );
+		const __m128 m8 = _mm_set1_ps( m[8] ), m9 = _mm_set1_ps( m[9] ), m10 = _mm_set1_ps( m[10] ), m11 = _mm_set1_ps( m[11] );
+		const __m128 t0 = _mm_set1_ps( m[12] * w ), t1 = _mm_set1_ps( m[13] * w ), t2 = _mm_set1_ps( m[14] * w ), t3 = _mm_set1_ps( m[15] * w );
+		for( ; i + 4 <= end; i += 4 ){
+			const __m128 px = _mm_loadu_ps( x + i ), py = _mm_loadu_ps( y + i ), pz = _mm_loadu_ps( z + i );
+			__m128 rx = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, m0 ), _mm_mul_ps( py, m4 ) ), _mm_mul_ps( pz, m8 ) ), t0 );
+			__m128 ry = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, m1 ), _mm_mul_ps( py, m5 ) ), _mm_mul_ps( pz, m9 ) ), t1 );
+			__m128 rz = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, m2 ), _mm_mul_ps( py, m6 ) ), _mm_mul_ps( pz, m10 ) ), t2 );
+			if( need_w ){
+				const __m128 rw = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, m3 ), _mm_mul_ps( py, m7 ) ), _mm_mul_ps( pz, m11 ) ), t3 );
+				if( out_w ){ _mm_storeu_ps( out_w + i, rw ); }
+				if( divide ){ rx = _mm_div_ps( rx, rw ); ry = _mm_div_ps( ry, rw ); rz = _mm_div_ps( rz, rw ); }
+			}
+			_mm_storeu_ps( out_x + i, rx );
+			_mm_storeu_ps( out_y + i, ry );
+			_mm_storeu_ps( out_z + i, rz );
+		}
+#endif
+		// Same operations in the same order as the SSE loop, so the tail matches it
+		for( ; i < end; ++i ){
+			const float px = x[i], py = y[i], pz = z[i];
+			float rx = px * m[0] + py * m[4] + pz * m[8] + m[12] * w;
+			float ry = px * m[1] + py * m[5] + pz * m[9] + m[13] * w;
+			float rz = px * m[2] + py * m[6] + pz * m[10] + m[14] * w;
+			if( need_w ){
+				const float rw = px * m[3] + py * m[7] + pz * m[11] + m[15] * w;
+				if( out_w ){ out_w[i] = rw; }
+				if( divide ){ rx /= rw; ry /= rw; rz /= rw; }
+			}
+			out_x[i] = rx;
+			out_y[i] = ry;
+			out_z[i] = rz;
+		}
+	}, options.grain );
+}
+
+static inline void transform_strided( const GLmatrix &matrix, const float *in, size_t in_stride, size_t count,
+									  float *out, size_t out_stride, const TransformOptions &options )
+{
+	const float *m = matrix;	// composed here, before the workers read it
+	const float w = options.directions ? 0.f : 1.f;
+	const bool divide = options.perspective_divide && !options.directions;
+	auto point_in = [&]( size_t i ){ return reinterpret_cast<const float*>( reinterpret_cast<const char*>(in) + i * in_stride ); };
+	auto point_out = [&]( size_t i ){ return reinterpret_cast<float*>( reinterpret_cast<char*>(out) + i * out_stride ); };
+
+	parallel_for( count, options.threads, [&]( size_t begin, size_t end ){
+#if MATRIX_SSE
+		// One point per iteration, x * row 0 + y * row 1 + z * row 2 + w * row 3
+		const __m128 row0 = _mm_loadu_ps( m ), row1 = _mm_loadu_ps( m + 4 ), row2 = _mm_loadu_ps( m + 8 );
+		const __m128 row3 = _mm_mul_ps( _mm_loadu_ps( m + 12 ), _mm_set1_ps( w ) );
+		for( size_t i = begin; i < end; ++i ){
+			const float *p = point_in(i);
+			__m128 r = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( p[0] ), row0 ), _mm_mul_ps( _mm_set1_ps( p[1] ), row1 ) ),
+											  _mm_mul_ps( _mm_set1_ps( p[2] ), row2 ) ), row3 );
+			if( divide ){ r = _mm_div_ps( r, _mm_shuffle_ps( r, r, _MM_SHUFFLE(3, 3, 3, 3) ) ); }
+
+			// 12 bytes, whatever follows the position (say a Vertex's color) is left alone
+			float *q = point_out(i);
+			_mm_storel_pi( reinterpret_cast<__m64*>( q ), r );
+			_mm_store_ss( q + 2, _mm_movehl_ps( r, r ) );
+		}
+#else
+		for( size_t i = begin; i < end; ++i ){
+			const float *p = point_in(i);
+			const float px = p[0], py = p[1], pz = p[2];
+			float rx = px * m[0] + py * m[4] + pz * m[8] + m[12] * w;
+			float ry = px * m[1] + py * m[5] + pz * m[9] + m[13] * w;
+			float rz = px * m[2] + py * m[6] + pz * m[10] + m[14] * w;
+			if( divide ){
+				const float rw = px * m[3] + py * m[7] + pz * m[11] + m[15] * w;
+				rx /= rw; ry /= rw; rz /= rw;
+			}
+			float *q = point_out(i);
+			q[0] = rx; q[1] = ry; q[2] = rz;
+		}
+#endif
+	}, options.grain );
+}
+
+static inline void transform_mesh_positions( TriMesh &mesh, const GLmatrix &matrix, const TransformOptions &options )
+{
+	TransformOptions points = options;
+	points.directions = false;
+	if( mesh.interleaved() ){
+		float *positions = &mesh.packed[0].position[0];
+		transform_strided( matrix, positions, sizeof(Vertex), mesh.packed.size(), positions, sizeof(Vertex), points );
+	} else if( !mesh.vertices.empty() ){
+		float *positions = &mesh.vertices[0][0];
+		transform_strided( matrix, positions, sizeof(Vec3f), mesh.vertices.size(), positions, sizeof(Vec3f), points );
+	}
+}
+
+#endif
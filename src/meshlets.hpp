@@ -0,0 +1,233 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef MESHLETS_HPP
+#define MESHLETS_HPP 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Meshlets, small spatially coherent clusters of triangles
+//
+//	build_meshlets() splits the faces by their centroids, at the median
+//	of the longest axis, until every piece has at most max_triangles.
+//	Cutting a range of more than max_triangles in half leaves at least
+//	half of max_triangles on each side, so with the default of 128 every
+//	meshlet has 64 to 128 triangles (only a mesh smaller than 64 makes
+//	a smaller one). The first levels are split until there is enough
+//	work for every thread, then each thread finishes its own ranges.
+//
+//	The faces aren't touched, a meshlet is a range of MeshletTable::triangles
+//	which holds face indices. Everything per meshlet is stored one array
+//	per field so culling passes only stream the fields they test:
+//	- the AABB of its vertices
+//	- a bounding sphere around the AABB's center
+//	- a normal cone, the average face normal and the cosine of the widest
+//	  angle from it to any face normal; cone_cos <= 0 means the faces point
+//	  every which way and the cone can't cull
+//
+//	Example use:
+//	MeshletTable meshlets;
+//	build_meshlets( mesh.arrays(), meshlets );
+//	for( size_t m = 0; m < meshlets.size(); ++m ){
+//		if( meshlet_backfacing( meshlets, m, eye ) ){ continue; }
+//		< faces meshlets.triangles[ first_triangle[m] .. first_triangle[m] + num_triangles[m] ) >
+//	}
+//
+
+struct MeshletOptions {
+	uint32_t max_triangles = 128;
+	unsigned threads = 0;
+};
+
+struct MeshletTable {
+	std::vector<uint32_t> triangles;	// face indices, meshlet by meshlet
+
+	std::vector<uint32_t> first_triangle, num_triangles;
+	std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+	std::vector<float> center_x, center_y, center_z, radius;
+	std::vector<float> cone_x, cone_y, cone_z, cone_cos;
+
+	size_t size() const { return first_triangle.size(); }
+
+	inline void clear();
+	inline void resize( size_t n );
+};
+
+// Splits the mesh's faces into meshlets and computes their bounds
+static inline void build_meshlets( const MeshArrays &mesh, MeshletTable &out, const MeshletOptions &options = MeshletOptions() );
+
+// True if every face of the meshlet faces away from the eye, wherever in the bounding sphere it is
+static inline bool meshlet_backfacing( const MeshletTable &meshlets, size_t m, const Vec3f &eye );
+
+
+//
+//	Implementation
+//
+
+void MeshletTable::clear()
+{
+	resize( 0 );
+	triangles.clear();
+}
+
+void MeshletTable::resize( size_t n )
+{
+	for( std::vector<uint32_t> *field : { &first_triangle, &num_triangles } ){ field->resize( n ); }
+	for( std::vector<float> *field : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z,
+		&center_x, &center_y, &center_z, &radius, &cone_x, &cone_y, &cone_z, &cone_cos } ){ field->resize( n ); }
+}
+
+static inline void build_meshlets( const MeshArrays &mesh, MeshletTable &out, const MeshletOptions &options )
+{
+	out.clear();
+	const size_t nf = mesh.num_faces;
+	if( nf == 0 ){ return; }
+	const uint32_t max_triangles = std::max<uint32_t>( options.max_triangles, 1 );
+
+	// Face centroids and unit normals
+	std::vector<Vec3f> centroids( nf ), normals( nf );
+	parallel_for( nf, options.threads, [&]( size_t begin, size_t end ){
+		for( size_t f = begin; f < end; ++f ){
+			const Vec3f &p0 = mesh.vertex( mesh.faces[f][0] ), &p1 = mesh.vertex( mesh.faces[f][1] ), &p2 = mesh.vertex( mesh.faces[f][2] );
+			for( int k = 0; k < 3; ++k ){ centroids[f][k] = (p0[k] + p1[k] + p2[k]) * (1.f / 3.f); }
+			normals[f] = (p1 - p0).cross( p2 - p0 );
+			normals[f].normalize();
+		}
+	});
+
+	out.triangles.resize( nf );
+	std::iota( out.triangles.begin(), out.triangles.end(), 0u );
+
+	struct Range { size_t begin, end; };
+
+	// Halves [begin,end) of out.triangles at the centroid median of its longest axis
+	auto split = [&]( const Range &r ){
+		Vec3f lo = centroids[ out.triangles[r.begin] ], hi = lo;
+		for( size_t i = r.begin + 1; i < r.end; ++i ){
+			const Vec3f &c = centroids[ out.triangles[i] ];
+			for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], c[k] ); hi[k] = std::max( hi[k], c[k] ); }
+		}
+		int axis = 0;
+		for( int k = 1; k < 3; ++k ){ if( hi[k] - lo[k] > hi[axis] - lo[axis] ){ axis = k; } }
+
+		const size_t middle = r.begin + (r.end - r.begin) / 2;
+		std::nth_element( out.triangles.begin() + r.begin, out.triangles.begin() + middle, out.triangles.begin() + r.end,
+			[&]( uint32_t a, uint32_t b ){ return centroids[a][axis] < centroids[b][axis]; } );
+		return middle;
+	};
+
+	// Split level by level until every thread has a few ranges to itself
+	const size_t workers = worker_count( options.threads );
+	std::vector<Range> ranges = { Range{ 0, nf } }, next;
+	for( bool splittable = nf > max_triangles; splittable && ranges.size() < workers * 4; ){
+		next.assign( ranges.size() * 2, Range{ 0, 0 } );
+		parallel_tasks( ranges.size(), options.threads, [&]( size_t r ){
+			if( ranges[r].end - ranges[r].begin <= max_triangles ){
+				next[r*2] = ranges[r];
+				return;
+			}
+			const size_t middle = split( ranges[r] );
+			next[r*2] = Range{ ranges[r].begin, middle };
+			next[r*2 + 1] = Range{ middle, ranges[r].end };
+		});
+		ranges.clear();
+		splittable = false;
+		for( const Range &r : next ){
+			if( r.end == r.begin ){ continue; }
+			ranges.push_back( r );
+			splittable = splittable || r.end - r.begin > max_triangles;
+		}
+	}
+
+	// Every range down to meshlets, depth first so they stay in spatial order
+	std::vector<std::vector<Range>> leaves( ranges.size() );
+	parallel_tasks( ranges.size(), options.threads, [&]( size_t r ){
+		std::vector<Range> stack = { ranges[r] };
+		while( !stack.empty() ){
+			const Range range = stack.back();
+			stack.pop_back();
+			if( range.end - range.begin <= max_triangles ){
+				leaves[r].push_back( range );
+				continue;
+			}
+			const size_t middle = split( range );
+			stack.push_back( Range{ middle, range.end } );
+			stack.push_back( Range{ range.begin, middle } );
+		}
+	});
+
+	size_t count = 0;
+	for( const std::vector<Range> &l : leaves ){ count += l.size(); }
+	out.resize( count );
+	count = 0;
+	for( const std::vector<Range> &l : leaves ){
+		for( const Range &range : l ){
+			out.first_triangle[count] = uint32_t(range.begin);
+			out.num_triangles[count] = uint32_t(range.end - range.begin);
+			++count;
+		}
+	}
+
+	// Bounds and normal cones
+	parallel_for( out.size(), options.threads, [&]( size_t begin, size_t end ){
+		for( size_t m = begin; m < end; ++m ){
+			const uint32_t *faces = &out.triangles[ out.first_triangle[m] ];
+			const uint32_t n = out.num_triangles[m];
+
+			Vec3f lo = mesh.vertex( mesh.faces[faces[0]][0] ), hi = lo, axis;
+			for( uint32_t t = 0; t < n; ++t ){
+				for( int c = 0; c < 3; ++c ){
+					const Vec3f &p = mesh.vertex( mesh.faces[faces[t]][c] );
+					for( int k = 0; k < 3; ++k ){ lo[k] = std::min( lo[k], p[k] ); hi[k] = std::max( hi[k], p[k] ); }
+				}
+				axis += normals[faces[t]];
+			}
+			Vec3f center;
+			for( int k = 0; k < 3; ++k ){ center[k] = 0.5f * (lo[k] + hi[k]); }
+			float radius = 0.f;
+			for( uint32_t t = 0; t < n; ++t ){
+				for( int c = 0; c < 3; ++c ){ radius = std::max( radius, float( (mesh.vertex( mesh.faces[faces[t]][c] ) - center).len() ) ); }
+			}
+
+			float cone_cos = -1.f;
+			if( axis.len() > 1e-6 ){
+				axis.normalize();
+				cone_cos = 1.f;
+				for( uint32_t t = 0; t < n; ++t ){ cone_cos = std::min( cone_cos, axis.dot( normals[faces[t]] ) ); }
+			}
+
+			out.min_x[m] = lo[0]; out.min_y[m] = lo[1]; out.min_z[m] = lo[2];
+			out.max_x[m] = hi[0]; out.max_y[m] = hi[1]; out.max_z[m] = hi[2];
+			out.center_x[m] = center[0]; out.center_y[m] = center[1]; out.center_z[m] = center[2];
+			out.radius[m] = radius;
+			out.cone_x[m] = axis[0]; out.cone_y[m] = axis[1]; out.cone_z[m] = axis[2];
+			out.cone_cos[m] = cone_cos;
+		}
+	}, 256 );
+}
+
+static inline bool meshlet_backfacing( const MeshletTable &meshlets, size_t m, const Vec3f &eye )
+{
+	const float cone_cos = meshlets.cone_cos[m];
+	if( cone_cos <= 0.f ){ return false; }
+
+	// Every face normal n is within acos(cone_cos) of the axis a and every point p within
+	// radius of the center c. With v = c - eye at angle t from a, dot(n, p - eye) is at
+	// least |v| cos(t + acos(cone_cos)) - radius, the faces point away if that is positive.
+	const Vec3f v( meshlets.center_x[m] - eye[0], meshlets.center_y[m] - eye[1], meshlets.center_z[m] - eye[2] );
+	const float distance = float(v.len());
+	if( distance <= meshlets.radius[m] ){ return false; }
+	const float cos_t = (v[0] * meshlets.cone_x[m] + v[1] * meshlets.cone_y[m] + v[2] * meshlets.cone_z[m]) / distance;
+	const float sin_t = std::sqrt( std::max( 0.f, 1.f - cos_t * cos_t ) );
+	const float sin_cone = std::sqrt( std::max( 0.f, 1.f - cone_cos * cone_cos ) );
+	return distance * (cos_t * cone_cos - sin_t * sin_cone) > meshlets.radius[m];
+}
+
+#endif
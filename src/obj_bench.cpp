@@ -0,0 +1,362 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+
+// OBJ ingest benchmark
+// Generates synthetic OBJ files and times TriMesh::load_obj, need_normals and build_meshlets on them.
+// With --spatial-sort the mesh is put in Morton order (spatial_sort_mesh) before the last two.
+//
+// Usage: obj_bench [--vertices N] [--runs N] [--threads N] [--weld] [--interleave] [--spatial-sort]
+//                  [--dir PATH] [--min-mb-per-s X] [--keep]
+//
+// Prints a single JSON object to stdout, progress goes to stderr. With --min-mb-per-s
+// the exit code is 1 if any case parses slower than that, so it can gate merges.
+
+#include "trimesh.hpp"
+#include "meshlets.hpp"
+#include "mesh_spatial_sort.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Defaults, overridden on the command line
+const size_t kDefaultVertices = 250000;
+const int kDefaultRuns = 7;
+
+// Shape of one synthetic mesh
+struct BenchCase {
+	bool quads;
+	bool normals;
+	bool colors;
+};
+
+// Mean, spread and best of a set of timings in milliseconds
+struct TimingStats {
+	double mean = 0.0;
+	double variance = 0.0;
+	double stddev = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+};
+
+// Results of one case
+struct BenchResult {
+	std::string name;
+	size_t bytes = 0;
+	size_t vertices = 0;
+	size_t triangles = 0;
+	size_t meshlets = 0;
+	TimingStats load;
+	TimingStats normals;
+	TimingStats meshletBuild;
+	TimingStats spatialSort;
+	SpatialSortStats lastSort;
+};
+
+
+//
+// Helper functions
+//
+std::string case_name(const BenchCase& benchCase);
+
+size_t write_synthetic_obj(const std::string& path, size_t numVertices, const BenchCase& benchCase);
+
+TimingStats compute_stats(const std::vector<double>& samples);
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results, unsigned threads, int runs, const ObjLoadOptions& loadOptions, bool spatialSort);
+
+
+//
+//	Main
+//
+int
+main(int argc, char* argv[])
+{
+	size_t numVertices = kDefaultVertices;
+	int runs = kDefaultRuns;
+	ObjLoadOptions loadOptions;
+	loadOptions.threads = 0;
+	double minMBPerSecond = 0.0;
+	bool keepFiles = false;
+	bool spatialSort = false;
+	std::filesystem::path dir = std::filesystem::temp_directory_path() / "obj_bench";
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--vertices" && hasValue)
+			numVertices = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--runs" && hasValue)
+			runs = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--threads" && hasValue)
+			loadOptions.threads = unsigned(std::atoi(argv[++i]));
+		else if (arg == "--weld")
+			loadOptions.weld_vertices = true;
+		else if (arg == "--interleave")
+			loadOptions.interleave = true;
+		else if (arg == "--spatial-sort")
+			spatialSort = true;
+		else if (arg == "--dir" && hasValue)
+			dir = argv[++i];
+		else if (arg == "--min-mb-per-s" && hasValue)
+			minMBPerSecond = std::atof(argv[++i]);
+		else if (arg == "--keep")
+			keepFiles = true;
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--vertices N] [--runs N] [--threads N] [--weld] [--interleave] [--spatial-sort] [--dir PATH] [--min-mb-per-s X] [--keep]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	// Every mix of quads/triangles, with/without vn and with/without vertex colors
+	std::vector<BenchCase> cases;
+	for (int quads = 0; quads < 2; ++quads)
+		for (int normals = 0; normals < 2; ++normals)
+			for (int colors = 0; colors < 2; ++colors)
+				cases.push_back(BenchCase{ quads != 0, normals != 0, colors != 0 });
+
+	// The loader talks on std::cout, keep stdout for the JSON
+	std::ostringstream loaderLog;
+
+	std::vector<BenchResult> results;
+	bool tooSlow = false;
+	for (const BenchCase& benchCase : cases) {
+		BenchResult result;
+		result.name = case_name(benchCase);
+		const std::string path = (dir / (result.name + ".obj")).string();
+		result.bytes = write_synthetic_obj(path, numVertices, benchCase);
+		if (result.bytes == 0) {
+			std::cerr << "Could not write " << path << '\n';
+			return EXIT_FAILURE;
+		}
+
+		std::vector<double> loadSamples, normalSamples, meshletSamples, sortSamples;
+		for (int run = 0; run < runs; ++run) {
+			TriMesh mesh;
+			std::streambuf* coutBuffer = std::cout.rdbuf(loaderLog.rdbuf());
+			Stopwatch timer;
+			const bool loaded = mesh.load_obj(path, loadOptions);
+			const double loadMs = timer.lap();
+			SpatialSortOptions sortOptions;
+			sortOptions.threads = loadOptions.threads;
+			if (loaded && spatialSort)
+				result.lastSort = spatial_sort_mesh(mesh, sortOptions);
+			const double sortMs = timer.lap();
+			if (loaded)
+				mesh.need_normals(true);
+			const double normalsMs = timer.lap();
+			MeshletTable meshlets;
+			MeshletOptions meshletOptions;
+			meshletOptions.threads = loadOptions.threads;
+			if (loaded)
+				build_meshlets(mesh.arrays(), meshlets, meshletOptions);
+			const double meshletsMs = timer.lap();
+			std::cout.rdbuf(coutBuffer);
+			loaderLog.str(std::string());
+
+			if (!loaded) {
+				std::cerr << "Could not load " << path << '\n';
+				return EXIT_FAILURE;
+			}
+
+			loadSamples.push_back(loadMs);
+			normalSamples.push_back(normalsMs);
+			meshletSamples.push_back(meshletsMs);
+			sortSamples.push_back(sortMs);
+			result.vertices = mesh.num_vertices();
+			result.triangles = mesh.faces.size();
+			result.meshlets = meshlets.size();
+		}
+
+		result.load = compute_stats(loadSamples);
+		result.normals = compute_stats(normalSamples);
+		result.meshletBuild = compute_stats(meshletSamples);
+		result.spatialSort = compute_stats(sortSamples);
+
+		const double mbPerSecond = double(result.bytes) / (1024.0 * 1024.0) / (result.load.mean / 1000.0);
+		std::cerr << result.name << ": " << mbPerSecond << " MB/s, "
+			<< double(result.triangles) / (result.load.mean / 1000.0) << " tris/s, "
+			<< result.load.mean << " +- " << result.load.stddev << " ms\n";
+		if (minMBPerSecond > 0.0 && mbPerSecond < minMBPerSecond)
+			tooSlow = true;
+
+		if (!keepFiles)
+			std::filesystem::remove(path, ec);
+		results.push_back(result);
+	}
+
+	write_json(std::cout, results, worker_count(loadOptions.threads), runs, loadOptions, spatialSort);
+	std::cout << '\n';
+
+	return tooSlow ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+std::string
+case_name(const BenchCase& benchCase)
+{
+	std::string name = benchCase.quads ? "quads" : "tris";
+	name += benchCase.normals ? "_vn" : "_novn";
+	name += benchCase.colors ? "_colors" : "_nocolors";
+	return name;
+}
+
+size_t
+write_synthetic_obj(const std::string& path, size_t numVertices, const BenchCase& benchCase)
+{
+	// A bumpy square grid, side x side vertices with one normal per vertex
+	const size_t side = std::max<size_t>(2, size_t(std::sqrt(double(numVertices))));
+	const float spacing = 1.f / float(side - 1);
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return 0;
+
+	std::string buffer;
+	buffer.reserve(1 << 20);
+	char number[64];
+	auto putFloat = [&](float value) {
+		const std::to_chars_result r = std::to_chars(number, number + sizeof(number), value, std::chars_format::fixed, 6);
+		buffer.append(number, r.ptr);
+	};
+	auto putInt = [&](size_t value) {
+		const std::to_chars_result r = std::to_chars(number, number + sizeof(number), value);
+		buffer.append(number, r.ptr);
+	};
+	auto flush = [&](bool force) {
+		if (force || buffer.size() > (1 << 20) - 256) {
+			out.write(buffer.data(), std::streamsize(buffer.size()));
+			buffer.clear();
+		}
+	};
+
+	buffer += "# synthetic benchmark mesh\n";
+	for (size_t y = 0; y < side; ++y) {
+		for (size_t x = 0; x < side; ++x) {
+			const float px = float(x) * spacing, pz = float(y) * spacing;
+			const float py = 0.05f * std::sin(px * 40.f) * std::cos(pz * 40.f);
+			buffer += "v ";
+			putFloat(px); buffer += ' ';
+			putFloat(py); buffer += ' ';
+			putFloat(pz);
+			if (benchCase.colors) {
+				buffer += ' '; putFloat(px);
+				buffer += ' '; putFloat(0.5f);
+				buffer += ' '; putFloat(pz);
+			}
+			buffer += '\n';
+			flush(false);
+		}
+	}
+
+	if (benchCase.normals) {
+		for (size_t y = 0; y < side; ++y) {
+			for (size_t x = 0; x < side; ++x) {
+				const float px = float(x) * spacing, pz = float(y) * spacing;
+				const float dx = -2.f * std::cos(px * 40.f) * std::cos(pz * 40.f);
+				const float dz = 2.f * std::sin(px * 40.f) * std::sin(pz * 40.f);
+				const float length = std::sqrt(dx * dx + 1.f + dz * dz);
+				buffer += "vn ";
+				putFloat(dx / length); buffer += ' ';
+				putFloat(1.f / length); buffer += ' ';
+				putFloat(dz / length);
+				buffer += '\n';
+				flush(false);
+			}
+		}
+	}
+
+	// OBJ indices start at 1, and each vertex uses the normal with the same index
+	auto putCorner = [&](size_t index) {
+		buffer += ' ';
+		putInt(index + 1);
+		if (benchCase.normals) {
+			buffer += "//";
+			putInt(index + 1);
+		}
+	};
+
+	for (size_t y = 0; y + 1 < side; ++y) {
+		for (size_t x = 0; x + 1 < side; ++x) {
+			const size_t i00 = y * side + x, i10 = i00 + 1, i01 = i00 + side, i11 = i01 + 1;
+			if (benchCase.quads) {
+				buffer += 'f'; putCorner(i00); putCorner(i01); putCorner(i11); putCorner(i10); buffer += '\n';
+			} else {
+				buffer += 'f'; putCorner(i00); putCorner(i01); putCorner(i11); buffer += '\n';
+				buffer += 'f'; putCorner(i00); putCorner(i11); putCorner(i10); buffer += '\n';
+			}
+			flush(false);
+		}
+	}
+	flush(true);
+
+	return out ? size_t(out.tellp()) : 0;
+}
+
+TimingStats
+compute_stats(const std::vector<double>& samples)
+{
+	TimingStats stats;
+	if (samples.empty())
+		return stats;
+
+	const double count = double(samples.size());
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / count;
+	for (double sample : samples)
+		stats.variance += (sample - stats.mean) * (sample - stats.mean);
+	stats.variance = samples.size() > 1 ? stats.variance / (count - 1.0) : 0.0;
+	stats.stddev = std::sqrt(stats.variance);
+	stats.min = *std::min_element(samples.begin(), samples.end());
+	stats.max = *std::max_element(samples.begin(), samples.end());
+	return stats;
+}
+
+void
+write_json(std::ostream& out, const std::vector<BenchResult>& results, unsigned threads, int runs, const ObjLoadOptions& loadOptions, bool spatialSort)
+{
+	auto putStats = [&](const char* name, const TimingStats& stats) {
+		out << ",\"" << name << "\":{\"mean_ms\":" << stats.mean << ",\"stddev_ms\":" << stats.stddev
+			<< ",\"variance_ms2\":" << stats.variance << ",\"min_ms\":" << stats.min << ",\"max_ms\":" << stats.max << "}";
+	};
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"benchmark\":\"obj_ingest\",\"threads\":" << threads << ",\"runs\":" << runs
+		<< ",\"weld_vertices\":" << (loadOptions.weld_vertices ? "true" : "false")
+		<< ",\"interleave\":" << (loadOptions.interleave ? "true" : "false")
+		<< ",\"spatial_sort\":" << (spatialSort ? "true" : "false") << ",\"cases\":[";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& result = results[i];
+		const double loadSeconds = result.load.mean / 1000.0;
+		const double normalsSeconds = result.normals.mean / 1000.0;
+		const double meshletSeconds = result.meshletBuild.mean / 1000.0;
+		out << (i ? "," : "") << "{\"name\":\"" << result.name << "\",\"bytes\":" << result.bytes
+			<< ",\"vertices\":" << result.vertices << ",\"triangles\":" << result.triangles << ",\"num_meshlets\":" << result.meshlets;
+		putStats("load", result.load);
+		putStats("normals", result.normals);
+		putStats("meshlets", result.meshletBuild);
+		if (spatialSort) {
+			const SpatialSortStats& sort = result.lastSort;
+			putStats("spatial_sort", result.spatialSort);
+			out << ",\"spatial_sort_split_ms\":{\"keys\":" << sort.keys_ms << ",\"sort\":" << sort.sort_ms << ",\"remap\":" << sort.remap_ms << "}"
+				<< ",\"lines_per_triangle_before\":" << sort.before.lines_per_triangle
+				<< ",\"lines_per_triangle_after\":" << sort.after.lines_per_triangle << ",\"locality_gain\":" << sort.gain();
+		}
+		out << ",\"load_mb_per_s\":" << double(result.bytes) / (1024.0 * 1024.0) / loadSeconds
+			<< ",\"load_tris_per_s\":" << double(result.triangles) / loadSeconds
+			<< ",\"normals_tris_per_s\":" << (normalsSeconds > 0.0 ? double(result.triangles) / normalsSeconds : 0.0)
+			<< ",\"meshlets_tris_per_s\":" << (meshletSeconds > 0.0 ? double(result.triangles) / meshletSeconds : 0.0) << "}";
+	}
+	out << "]}";
+}
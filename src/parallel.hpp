@@ -0,0 +1,59 @@
+// Assignment 2b - Learning About Viewing, Projection and Viewport Transformations via a First-Person 3D Walkthrough
+// Work by Jacob Secunda
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//
+//	Minimal fork/join helpers for the mesh passes.
+//
+
+// Number of workers to use for a requested thread count, 0 means every core
+static inline unsigned worker_count( unsigned requested )
+{
+	if( requested > 0 ){ return requested; }
+	unsigned hw = std::thread::hardware_concurrency();
+	return hw > 0 ? hw : 1;
+}
+
+// Runs fn(task) for every task in [0,tasks) on up to 'threads' threads.
+// Tasks are handed out in contiguous blocks, the calling thread takes the first one.
+template <typename F>
+static void parallel_tasks( size_t tasks, unsigned threads, F &&fn )
+{
+	const size_t workers = std::min<size_t>( worker_count(threads), tasks );
+	if( workers <= 1 ){
+		for( size_t t = 0; t < tasks; ++t ){ fn(t); }
+		return;
+	}
+
+	auto run_block = [&]( size_t w ){
+		const size_t begin = tasks * w / workers, end = tasks * (w+1) / workers;
+		for( size_t t = begin; t < end; ++t ){ fn(t); }
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve( workers - 1 );
+	for( size_t w = 1; w < workers; ++w ){ pool.emplace_back( run_block, w ); }
+	run_block( 0 );
+	for( std::thread &t : pool ){ t.join(); }
+}
+
+// Splits [0,count) into one contiguous range per worker and runs fn(begin,end) on each.
+// Ranges smaller than min_grain aren't worth a thread, so small inputs stay serial.
+template <typename F>
+static void parallel_for( size_t count, unsigned threads, F &&fn, size_t min_grain = 4096 )
+{
+	if( count == 0 ){ return; }
+	const size_t max_workers = std::max<size_t>( 1, count / std::max<size_t>(1, min_grain) );
+	const size_t workers = std::min<size_t>( worker_count(threads), max_workers );
+	parallel_tasks( workers, unsigned(workers), [&]( size_t w ){
+		fn( count * w / workers, count * (w+1) / workers );
+	});
+}
+
+#endif
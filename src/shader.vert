@@ -12,15 +12,34 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Quantized vertices (see mesh_quantize.hpp) come in as normalized integers:
+// positions in [0,1] across the mesh's bounding box and octahedral normals in xy.
+// Float vertices use an offset of 0, a scale of 1 and octahedral_normals off.
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform bool octahedral_normals;
+
+vec3 octahedral_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
+    // undo the quantization, if any
+    vec3 object_position = position_offset + in_position * position_scale;
+
     // pass the vertex color and normal information to the fragment shader (without any modification)
 	color = in_color;
-	normal = in_normal;
+	normal = octahedral_normals ? octahedral_decode(in_normal.xy) : in_normal;
     
     // determine what the vertex position will be after the model transformation and pass that information to the fragment shader, for use in the illumination calculations
-    position = vec3(model * vec4(in_position,1.0));
+    position = vec3(model * vec4(object_position,1.0));
     
     // apply the model, view, and projection transformations to the vertex position value that will be sent to the clipper, rasterizer, ...
-    gl_Position = projection * view * model * vec4(in_position,1.0);
+    gl_Position = projection * view * model * vec4(object_position,1.0);
 }
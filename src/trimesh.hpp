@@ -23,97 +23,135 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <memory_resource>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
 #include <iostream>
 
+#include "arena.hpp"
+#include "core/Vec.hpp"
+#include "load_report.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define TRIMESH_SSE2 1
+#endif
+
 //
-//	Vector Class
-//	Not complete, only has functions needed for this sample.
+//	Interleaved vertex, the attributes in shader location order
 //
-template <size_t D, class T>
-requires(D == 3)
-class Vec {
-public:
-	// Constructors
-	Vec(){ data[0]=T(0); data[1]=T(0); data[2]=T(0); }
-	Vec(T x_, T y_, T z_){ data[0]=x_; data[1]=y_; data[2]=z_; }
-
-	// Data
-	T data[D];
+struct Vertex {
+	Vec3f position;
+	Vec3f color;
+	Vec3f normal;
+};
+static_assert( sizeof(Vertex) == 9 * sizeof(float), "Vertex must be tightly packed" );
 
-	// Functions
-	T operator[](int i) const { return data[i]; }
-	T& operator[](int i){ return data[i]; }
+// The same without the color, what gets uploaded when every vertex has the same one
+struct UncoloredVertex {
+	Vec3f position;
+	Vec3f normal;
+};
+static_assert( sizeof(UncoloredVertex) == 6 * sizeof(float), "UncoloredVertex must be tightly packed" );
 
-	Vec<D,T>&
-	operator+=(const Vec<D,T> &x)
-	{
-		for(size_t i=0; i<D; ++i) {
-			data[i] += x[i];
-		}
-		return *this;
-	}
 
-	Vec<D,T>&
-	operator*=(const T &x)
-	{
-		for (size_t i=0; i<D; ++i)
-			data[i] *= x;
-		return *this;
-	}
+//
+//	Options for TriMesh::load_obj
+//
+struct ObjLoadOptions {
+	// Threads used to parse the file, 0 uses every core.
+	// The file is split into newline aligned chunks, one per thread.
+	unsigned threads = 1;
+
+	// Share one vertex between all face corners with the same
+	// (position, normal) pair instead of emitting one per corner.
+	bool weld_vertices = false;
+
+	// All scratch memory of the load comes out of this arena and is
+	// released in one go when the load ends, back to where it was when
+	// the load started, so what the caller allocated before stays. Pass
+	// the same arena to back to back loads to reuse its memory. Without
+	// one the loader makes its own, starting with a block of
+	// arena_block_size bytes.
+	Arena *arena = nullptr;
+	size_t arena_block_size = size_t(1) << 20;
+
+	// Store the result interleaved in TriMesh::packed instead of
+	// the separate vertices/colors/normals arrays.
+	bool interleave = false;
+
+	// Reorder triangles and vertices for the GPU, see mesh_optimize.hpp.
+	// load_obj itself doesn't, whoever loads runs optimize_mesh() after.
+	// It's an option so caches know which order they hold.
+	bool optimize = false;
+};
 
-	double len2() const { return this->dot(*this); } // squared length
-	double len() const { return sqrt(len2()); } // length
 
-	T
-	dot(const Vec<D,T> &v) const
-	{
-		T r(0);
-		for(size_t i=0; i<D; ++i){ r += v[i] * data[i]; }
-		return r;
-	}
+//
+//	Non-owning view of a mesh's arrays. Points either into a
+//	TriMesh or straight into a memory mapped mesh cache.
+//	For an interleaved mesh, interleaved is set and vertices, normals
+//	and colors point into it with a stride of sizeof(Vertex).
+//	Without per-vertex colors (num_colors is 0) every vertex is
+//	constant_color, and color(i) returns that.
+//
+struct MeshArrays {
+	const Vec3f *vertices = nullptr;
+	const Vec3f *normals = nullptr;
+	const Vec3f *colors = nullptr;
+	const Vec3i *faces = nullptr;
+	const Vertex *interleaved = nullptr;
+	size_t num_vertices = 0;
+	size_t num_normals = 0;
+	size_t num_colors = 0;
+	size_t num_faces = 0;
+	size_t stride = sizeof(Vec3f);	// bytes from one vertex (normal, color) to the next
+	Vec3f constant_color = Vec3f(0.4f, 0.4f, 0.4f);
+
+	const Vec3f& vertex( size_t i ) const { return at( vertices, i ); }
+	const Vec3f& normal( size_t i ) const { return at( normals, i ); }
+	const Vec3f& color( size_t i ) const { return num_colors > 0 ? at( colors, i ) : constant_color; }
+
+private:
+	const Vec3f& at( const Vec3f *base, size_t i ) const { return *reinterpret_cast<const Vec3f*>( reinterpret_cast<const char*>(base) + i * stride ); }
+};
 
-	Vec<3,T>
-	cross(const Vec<3,T> &v) const
-	requires(D == 3) // only defined for 3 dims
-	{
-		return Vec<3,T>(data[1]*v[2] - data[2]*v[1], data[2]*v[0] - data[0]*v[2], data[0]*v[1] - data[1]*v[0]);
-	}
+// Interleaves vertices [begin,end) of split arrays
+static inline void interleave_arrays( const MeshArrays &a, size_t begin, size_t end, std::vector<Vertex> &out );
+static inline void interleave_arrays( const MeshArrays &a, size_t begin, size_t end, std::vector<UncoloredVertex> &out );
 
-	void normalize()
-	{
-		double l = len();
-		if (l <= 0.0)
-			return;
 
-		for (size_t i=0; i<D; ++i)
-			data[i] = data[i] / l;
-	}
+//
+//	Vertex to face adjacency, compressed sparse rows.
+//	The face corners (3 * face + k) using vertex v are
+//	corners[ offsets[v] .. offsets[v+1] ), in face order.
+//
+struct VertexFaces {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> corners;
 };
 
-template <size_t D, class T>
-static inline const Vec<D,T>
-operator-(const Vec<D,T> &v1, const Vec<D,T> &v2)
-{
-	Vec<D,T> r;
-	for(size_t i=0; i<D; ++i)
-		r[i] = v1[i] - v2[i];
-	return r;
-}
+// Builds the adjacency, threads count and place the corners of their own range of faces
+static inline void build_vertex_faces( const Vec3i *faces, size_t num_faces, size_t num_vertices, VertexFaces &out, unsigned threads = 0 );
 
-template <size_t D, class T>
-static inline const Vec<D,T>
-operator*(const Vec<D,T> &v, const T &x)
-{
-	Vec<D,T> r;
-	for (size_t i=0; i<D; ++i)
-		r[i] = v[i] * x;
-	return r;
-}
 
-using Vec3f = Vec<3,float>;
-using Vec3i = Vec<3,int>;
+//
+//	Which normals TriMesh::update_normals changed. Only normals
+//	[first,end) have to be uploaded again, e.g. for split arrays:
+//	glBufferSubData( GL_ARRAY_BUFFER, first * sizeof(Vec3f), (end - first) * sizeof(Vec3f), &mesh.normals[first] );
+//
+struct NormalUpdate {
+	size_t first = 0;
+	size_t end = 0;		// first == end if nothing changed
+	size_t count = 0;	// normals recomputed, at most end - first
+};
 
 
 //
@@ -126,19 +164,67 @@ public:
 	std::vector<Vec3f> colors;
 	std::vector<Vec3i> faces;
 
+	// Color of every vertex while colors is empty. load_obj only fills
+	// colors when the file's vertex colors actually vary.
+	Vec3f constant_color = Vec3f(0.4f, 0.4f, 0.4f);
+
+	// Interleaved vertices, used instead of vertices/colors/normals
+	// after interleave() or when loaded with ObjLoadOptions::interleave.
+	// Keeps each vertex on one cache line for need_normals and uploads.
+	std::vector<Vertex> packed;
+
+	// Every packed color is constant_color. arrays() then reports no
+	// colors, so uploads leave the color slot out.
+	bool packed_constant_color = false;
+
+	// Timings and counters of the last load_obj (and need_normals)
+	LoadReport report;
+
+	// Vertex to face adjacency of the faces above, see vertex_faces()
+	VertexFaces adjacency;
+
 	// Compute normals if not loaded from obj
 	// or if recompute is set to true.
 	void need_normals(bool recompute = false);
 
-	// Sets a default vertex color if
-	// they haven't been set.
-	void need_colors(Vec3f default_color = Vec3f(0.4, 0.4, 0.4));
+	// Recompute only the normals that depend on moved vertices, or on the
+	// vertices of changed faces: every vertex sharing a face with them.
+	// Gives the same normals as need_normals(true), up to rounding.
+	NormalUpdate update_normals(const std::vector<uint32_t> &moved_vertices);
+	NormalUpdate update_face_normals(const std::vector<uint32_t> &changed_faces);
+
+	// The adjacency, built on first use and kept for update_normals.
+	// Whatever adds, removes or reorders faces calls invalidate_adjacency().
+	const VertexFaces& vertex_faces();
+	void invalidate_adjacency(){ adjacency = VertexFaces(); }
+
+	// Per-vertex colors, filled with constant_color
+	// if they haven't been set.
+	void need_colors();
+
+	// Drops per-vertex colors that are all the same, keeping
+	// the one color in constant_color. True if it dropped them.
+	bool compact_colors();
+
+	// True if every vertex has constant_color
+	bool has_constant_color() const { return interleaved() ? packed_constant_color : colors.empty(); }
 
 	// Loads an OBJ file
-	bool load_obj(std::string file);
+	bool load_obj(std::string file, const ObjLoadOptions &options = ObjLoadOptions());
 
 	// Prints details about the mesh
 	void print_details();
+
+	// View of the mesh's arrays, valid until the mesh is modified
+	MeshArrays arrays() const;
+
+	// Switch between the split and the interleaved layout
+	void interleave();
+	void deinterleave();
+	bool interleaved() const { return !packed.empty(); }
+
+	// Number of vertices, in either layout
+	size_t num_vertices() const { return interleaved() ? packed.size() : vertices.size(); }
 };
 
 
@@ -149,182 +235,891 @@ public:
 
 void TriMesh::print_details()
 {
-	std::cout << "Vertices: " << vertices.size() << std::endl;
-	std::cout << "Normals: " << normals.size() << std::endl;
-	std::cout << "Colors: " << colors.size() << std::endl;
+	if( interleaved() ){
+		std::cout << "Vertices (interleaved): " << packed.size();
+	} else {
+		std::cout << "Vertices: " << vertices.size() << std::endl;
+		std::cout << "Normals: " << normals.size() << std::endl;
+		std::cout << "Colors: " << colors.size();
+	}
+	if( has_constant_color() ){ std::cout << " (constant color " << constant_color[0] << " " << constant_color[1] << " " << constant_color[2] << ")"; }
+	std::cout << std::endl;
 	std::cout << "Faces: " << faces.size() << std::endl;
 }
 
 
-void TriMesh::need_normals( bool recompute )
+MeshArrays TriMesh::arrays() const
 {
-	if( vertices.size() == normals.size() && !recompute ){ return; }
-	if( normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
-	std::cout << "Computing TriMesh normals" << std::endl;
-	const int nv = normals.size();
-	for( int i = 0; i < nv; ++i ){ normals[i][0] = 0.f; normals[i][1] = 0.f; normals[i][2] = 0.f; }
-	int nf = faces.size();
-	for( int f = 0; f < nf; ++f ){
-		Vec3i face = faces[f];
-		const Vec3f &p0 = vertices[ face[0] ];
-		const Vec3f &p1 = vertices[ face[1] ];
-		const Vec3f &p2 = vertices[ face[2] ];
+	MeshArrays a;
+	a.faces = faces.data(); a.num_faces = faces.size();
+	if( interleaved() ){
+		a.interleaved = packed.data();
+		a.vertices = &packed[0].position;
+		a.normals = &packed[0].normal;
+		a.colors = &packed[0].color;
+		a.num_vertices = a.num_normals = packed.size();
+		a.num_colors = packed_constant_color ? 0 : packed.size();
+		a.constant_color = constant_color;
+		a.stride = sizeof(Vertex);
+		return a;
+	}
+	a.vertices = vertices.data(); a.num_vertices = vertices.size();
+	a.normals = normals.data(); a.num_normals = normals.size();
+	a.colors = colors.data(); a.num_colors = colors.size();
+	a.constant_color = constant_color;
+	return a;
+}
+
+
+void TriMesh::interleave()
+{
+	if( interleaved() || vertices.empty() ){ return; }
+	need_normals();
+	interleave_arrays( arrays(), 0, vertices.size(), packed );
+	packed_constant_color = colors.empty();
+	vertices = std::vector<Vec3f>();
+	colors = std::vector<Vec3f>();
+	normals = std::vector<Vec3f>();
+}
+
+
+void TriMesh::deinterleave()
+{
+	if( !interleaved() ){ return; }
+	const size_t nv = packed.size();
+	vertices.resize( nv ); colors.resize( packed_constant_color ? 0 : nv ); normals.resize( nv );
+	for( size_t i = 0; i < nv; ++i ){
+		vertices[i] = packed[i].position;
+		if( !packed_constant_color ){ colors[i] = packed[i].color; }
+		normals[i] = packed[i].normal;
+	}
+	packed = std::vector<Vertex>();
+	packed_constant_color = false;
+}
+
+
+static inline void build_vertex_faces( const Vec3i *faces, size_t num_faces, size_t num_vertices, VertexFaces &out, unsigned threads )
+{
+	out.offsets.assign( num_vertices + 1, 0 );
+	out.corners.resize( num_faces * 3 );
+
+	// Every worker counts the corners of its own faces straight into the shared counts,
+	// atomically only if there is more than one of them
+	const size_t face_workers = std::max<size_t>( 1, std::min<size_t>( worker_count(threads), num_faces / 4096 ) );
+	const bool shared = face_workers > 1;
+	auto claim = [shared]( uint32_t &counter ){
+		return shared ? std::atomic_ref<uint32_t>( counter ).fetch_add( 1, std::memory_order_relaxed ) : counter++;
+	};
+	parallel_tasks( face_workers, unsigned(face_workers), [&]( size_t w ){
+		const size_t lo = num_faces * w / face_workers, hi = num_faces * (w+1) / face_workers;
+		for( size_t f = lo; f < hi; ++f ){
+			for( int k = 0; k < 3; ++k ){ claim( out.offsets[ size_t( faces[f][k] ) + 1 ] ); }
+		}
+	});
+
+	// Exclusive prefix sum, split into vertex ranges
+	const size_t workers = std::max<size_t>( 1, std::min<size_t>( worker_count(threads), num_vertices / 4096 ) );
+	std::vector<uint32_t> totals( workers + 1, 0 );
+	parallel_tasks( workers, unsigned(workers), [&]( size_t w ){
+		const size_t lo = num_vertices * w / workers, hi = num_vertices * (w+1) / workers;
+		uint32_t total = 0;
+		for( size_t v = lo; v < hi; ++v ){ total += out.offsets[v + 1]; }
+		totals[w + 1] = total;
+	});
+	for( size_t w = 0; w < workers; ++w ){ totals[w + 1] += totals[w]; }
+
+	std::vector<uint32_t> next( num_vertices );
+	parallel_tasks( workers, unsigned(workers), [&]( size_t w ){
+		const size_t lo = num_vertices * w / workers, hi = num_vertices * (w+1) / workers;
+		uint32_t running = totals[w];
+		for( size_t v = lo; v < hi; ++v ){
+			next[v] = running;
+			running += out.offsets[v + 1];
+			out.offsets[v + 1] = running;
+		}
+	});
+
+	// Scatter the corners over the same face ranges, workers race for the slots of a shared vertex
+	parallel_tasks( face_workers, unsigned(face_workers), [&]( size_t w ){
+		const size_t lo = num_faces * w / face_workers, hi = num_faces * (w+1) / face_workers;
+		for( size_t f = lo; f < hi; ++f ){
+			for( int k = 0; k < 3; ++k ){ out.corners[ claim( next[ size_t( faces[f][k] ) ] ) ] = uint32_t(f * 3 + k); }
+		}
+	});
+	if( !shared ){ return; }
+
+	// So put every vertex's corners back in face order, a corner is 3 * face + k
+	parallel_for( num_vertices, threads, [&]( size_t begin, size_t end ){
+		for( size_t v = begin; v < end; ++v ){
+			uint32_t *first = out.corners.data() + out.offsets[v], *last = out.corners.data() + out.offsets[v + 1];
+			if( !std::is_sorted( first, last ) ){ std::sort( first, last ); }
+		}
+	});
+}
+
+
+static inline void interleave_arrays( const MeshArrays &a, size_t begin, size_t end, std::vector<Vertex> &out )
+{
+	out.resize( end - begin );
+	const bool has_colors = a.num_colors >= end, has_normals = a.num_normals >= end;
+	for( size_t i = begin; i < end; ++i ){
+		Vertex &v = out[i - begin];
+		v.position = a.vertex(i);
+		v.color = has_colors ? a.color(i) : a.constant_color;
+		v.normal = has_normals ? a.normal(i) : Vec3f();
+	}
+}
+
+static inline void interleave_arrays( const MeshArrays &a, size_t begin, size_t end, std::vector<UncoloredVertex> &out )
+{
+	out.resize( end - begin );
+	const bool has_normals = a.num_normals >= end;
+	for( size_t i = begin; i < end; ++i ){
+		UncoloredVertex &v = out[i - begin];
+		v.position = a.vertex(i);
+		v.normal = has_normals ? a.normal(i) : Vec3f();
+	}
+}
+
+
+//
+//	need_normals helpers
+//
+namespace normals_detail {
+
+// Face normal (cross product of two edges, so area weighted) divided by the squared
+// lengths of the two edges at each corner, for faces [begin,end): out[3*f + k] is
+// what corner k adds to its vertex. Degenerate faces add nothing.
+template <typename Position>
+static inline void weighted_face_normals( const Vec3i *faces, size_t begin, size_t end, Position &&position, Vec3f *out )
+{
+	size_t f = begin;
+#ifdef TRIMESH_SSE2
+	// Four faces at a time, one per lane
+	for( ; f + 4 <= end; f += 4 ){
+		// Corner c of the four faces, transposed to x, y, z and an unused row
+		__m128 p[3][4];
+		for( int c = 0; c < 3; ++c ){
+			for( int lane = 0; lane < 4; ++lane ){
+				const Vec3f &v = position( faces[f + lane][c] );
+				p[c][lane] = _mm_setr_ps( v[0], v[1], v[2], 0.f );
+			}
+			_MM_TRANSPOSE4_PS( p[c][0], p[c][1], p[c][2], p[c][3] );
+		}
+		__m128 a[3], b[3], c[3];
+		for( int k = 0; k < 3; ++k ){
+			a[k] = _mm_sub_ps( p[0][k], p[1][k] ); b[k] = _mm_sub_ps( p[1][k], p[2][k] ); c[k] = _mm_sub_ps( p[2][k], p[0][k] );
+		}
+		auto len2 = []( const __m128 *e ){ return _mm_add_ps( _mm_add_ps( _mm_mul_ps( e[0], e[0] ), _mm_mul_ps( e[1], e[1] ) ), _mm_mul_ps( e[2], e[2] ) ); };
+		const __m128 l2a = len2( a ), l2b = len2( b ), l2c = len2( c );
+
+		alignas(16) float n[3][4], w[3][4];
+		_mm_store_ps( n[0], _mm_sub_ps( _mm_mul_ps( a[1], b[2] ), _mm_mul_ps( a[2], b[1] ) ) );
+		_mm_store_ps( n[1], _mm_sub_ps( _mm_mul_ps( a[2], b[0] ), _mm_mul_ps( a[0], b[2] ) ) );
+		_mm_store_ps( n[2], _mm_sub_ps( _mm_mul_ps( a[0], b[1] ), _mm_mul_ps( a[1], b[0] ) ) );
+
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.f );
+		const __m128 valid = _mm_and_ps( _mm_and_ps( _mm_cmpneq_ps( l2a, zero ), _mm_cmpneq_ps( l2b, zero ) ), _mm_cmpneq_ps( l2c, zero ) );
+		_mm_store_ps( w[0], _mm_and_ps( valid, _mm_div_ps( one, _mm_mul_ps( l2a, l2c ) ) ) );
+		_mm_store_ps( w[1], _mm_and_ps( valid, _mm_div_ps( one, _mm_mul_ps( l2b, l2a ) ) ) );
+		_mm_store_ps( w[2], _mm_and_ps( valid, _mm_div_ps( one, _mm_mul_ps( l2c, l2b ) ) ) );
+
+		for( int lane = 0; lane < 4; ++lane ){
+			for( int k = 0; k < 3; ++k ){
+				out[(f + lane) * 3 + k] = Vec3f( n[0][lane] * w[k][lane], n[1][lane] * w[k][lane], n[2][lane] * w[k][lane] );
+			}
+		}
+	}
+#endif
+	for( ; f < end; ++f ){
+		const Vec3f &p0 = position( faces[f][0] );
+		const Vec3f &p1 = position( faces[f][1] );
+		const Vec3f &p2 = position( faces[f][2] );
 		Vec3f a = p0-p1,  b = p1-p2, c = p2-p0;
 		float l2a = a.len2(), l2b = b.len2(), l2c = c.len2();
-		if (!l2a || !l2b || !l2c){ continue; } // check for zeros or nans
+		Vec3f *corner = out + f * 3;
+		if (!l2a || !l2b || !l2c){ corner[0] = corner[1] = corner[2] = Vec3f(); continue; } // check for zeros or nans
 		Vec3f facenormal = a.cross( b );
-		normals[faces[f][0]] += facenormal * (1.0f / (l2a * l2c));
-		normals[faces[f][1]] += facenormal * (1.0f / (l2b * l2a));
-		normals[faces[f][2]] += facenormal * (1.0f / (l2c * l2b));
+		corner[0] = facenormal * (1.0f / (l2a * l2c));
+		corner[1] = facenormal * (1.0f / (l2b * l2a));
+		corner[2] = facenormal * (1.0f / (l2c * l2b));
 	}
-	for (int i = 0; i < nv; i++){ normals[i].normalize(); }
+}
+
+// normal(v) = sum(v) normalized, for vertices [begin,end)
+template <typename Sum, typename Normal>
+static inline void normalize_normals( size_t begin, size_t end, Sum &&sum, Normal &&normal )
+{
+	size_t v = begin;
+#ifdef TRIMESH_SSE2
+	// rsqrt estimate plus one Newton-Raphson step, zero vectors stay zero
+	for( ; v + 4 <= end; v += 4 ){
+		alignas(16) float n[3][4];
+		for( int lane = 0; lane < 4; ++lane ){
+			const Vec3f s = sum( v + lane );
+			n[0][lane] = s[0]; n[1][lane] = s[1]; n[2][lane] = s[2];
+		}
+		const __m128 x = _mm_load_ps( n[0] ), y = _mm_load_ps( n[1] ), z = _mm_load_ps( n[2] );
+		const __m128 l2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_mul_ps( z, z ) );
+		__m128 r = _mm_rsqrt_ps( l2 );
+		r = _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), l2 ), _mm_mul_ps( r, r ) ) ) );
+		r = _mm_and_ps( r, _mm_cmpgt_ps( l2, _mm_setzero_ps() ) );
+		_mm_store_ps( n[0], _mm_mul_ps( x, r ) );
+		_mm_store_ps( n[1], _mm_mul_ps( y, r ) );
+		_mm_store_ps( n[2], _mm_mul_ps( z, r ) );
+		for( int lane = 0; lane < 4; ++lane ){ normal( v + lane ) = Vec3f( n[0][lane], n[1][lane], n[2][lane] ); }
+	}
+#endif
+	for( ; v < end; ++v ){
+		Vec3f n = sum( v );
+		n.normalize();
+		normal( v ) = n;
+	}
+}
+
+// Sums the corners of vertices [begin,end) and normalizes
+template <typename Normal>
+static inline void gather_normals( const VertexFaces &adjacency, const Vec3f *weighted, size_t begin, size_t end, Normal &&normal )
+{
+	normalize_normals( begin, end, [&]( size_t v ){
+		Vec3f n;
+		for( uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i ){ n += weighted[ adjacency.corners[i] ]; }
+		return n;
+	}, normal );
+}
+
+} // end namespace normals_detail
+
+void TriMesh::need_normals( bool recompute )
+{
+	// Interleaved vertices always have a normal slot
+	if( (interleaved() || vertices.size() == normals.size()) && !recompute ){ return; }
+	if( !interleaved() && normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
+	std::cout << "Computing TriMesh normals" << std::endl;
+	Stopwatch timer;
+
+	// Same passes for both layouts, position(i) and normal(i) pick the storage.
+	// Each face corner's share is computed first, then every vertex gathers its
+	// own corners, so no two threads write the same normal. The adjacency lists
+	// corners in face order, the sums add up in the same order a serial loop would.
+	auto compute = [&]( auto &&position, auto &&normal ){
+		const size_t nv = num_vertices(), nf = faces.size();
+
+		// On one core building the adjacency costs more than it saves, scatter in face order instead
+		if( worker_count(0) == 1 ){
+			for( size_t i = 0; i < nv; ++i ){ normal(i) = Vec3f(); }
+			Vec3f weighted[3 * 1024];
+			for( size_t begin = 0; begin < nf; begin += 1024 ){
+				const size_t end = std::min( nf, begin + 1024 );
+				normals_detail::weighted_face_normals( faces.data() + begin, 0, end - begin, position, weighted );
+				for( size_t f = begin; f < end; ++f ){
+					for( int k = 0; k < 3; ++k ){ normal( faces[f][k] ) += weighted[(f - begin) * 3 + k]; }
+				}
+			}
+			normals_detail::normalize_normals( 0, nv, [&]( size_t v ){ return normal(v); }, normal );
+			return;
+		}
+
+		std::vector<Vec3f> weighted( nf * 3 );
+		parallel_for( nf, 0, [&]( size_t begin, size_t end ){
+			normals_detail::weighted_face_normals( faces.data(), begin, end, position, weighted.data() );
+		});
+		build_vertex_faces( faces.data(), nf, nv, adjacency );
+		parallel_for( nv, 0, [&]( size_t begin, size_t end ){
+			normals_detail::gather_normals( adjacency, weighted.data(), begin, end, normal );
+		});
+	};
+	if( interleaved() ){
+		compute( [this]( size_t i ) -> const Vec3f& { return packed[i].position; }, [this]( size_t i ) -> Vec3f& { return packed[i].normal; } );
+	} else {
+		compute( [this]( size_t i ) -> const Vec3f& { return vertices[i]; }, [this]( size_t i ) -> Vec3f& { return normals[i]; } );
+	}
+	report.normals_ms = timer.lap();
 } // end need normals
 
-void TriMesh::need_colors( Vec3f default_color )
+const VertexFaces& TriMesh::vertex_faces()
+{
+	if( adjacency.offsets.size() != num_vertices() + 1 || adjacency.corners.size() != faces.size() * 3 ){
+		build_vertex_faces( faces.data(), faces.size(), num_vertices(), adjacency );
+	}
+	return adjacency;
+}
+
+NormalUpdate TriMesh::update_normals( const std::vector<uint32_t> &moved_vertices )
+{
+	// The faces around the moved vertices are the ones whose normals changed
+	const VertexFaces &around = vertex_faces();
+	std::vector<uint32_t> changed_faces;
+	for( uint32_t v : moved_vertices ){
+		if( v >= num_vertices() ){ continue; }
+		for( uint32_t i = around.offsets[v]; i < around.offsets[v + 1]; ++i ){ changed_faces.push_back( around.corners[i] / 3 ); }
+	}
+	return update_face_normals( changed_faces );
+}
+
+NormalUpdate TriMesh::update_face_normals( const std::vector<uint32_t> &changed_faces )
 {
+	NormalUpdate update;
+	if( !interleaved() && normals.size() != vertices.size() ){
+		// Nothing to update yet, compute them all
+		need_normals();
+		update.end = update.count = num_vertices();
+		return update;
+	}
+
+	// Every vertex of a changed face, once. Sorting keeps this to the size of the edit, not the mesh
+	std::vector<uint32_t> dirty;
+	dirty.reserve( changed_faces.size() * 3 );
+	for( uint32_t f : changed_faces ){
+		if( f >= faces.size() ){ continue; }
+		for( int k = 0; k < 3; ++k ){ dirty.push_back( uint32_t(faces[f][k]) ); }
+	}
+	if( dirty.empty() ){ return update; }
+	std::sort( dirty.begin(), dirty.end() );
+	dirty.erase( std::unique( dirty.begin(), dirty.end() ), dirty.end() );
+
+	// Same sums as need_normals, over each dirty vertex's faces in face order
+	const VertexFaces &around = vertex_faces();
+	auto compute = [&]( auto &&position, auto &&normal ){
+		parallel_for( dirty.size(), 0, [&]( size_t begin, size_t end ){
+			normals_detail::normalize_normals( begin, end, [&]( size_t i ){
+				const uint32_t v = dirty[i];
+				Vec3f n, weighted[3];
+				for( uint32_t c = around.offsets[v]; c < around.offsets[v + 1]; ++c ){
+					const size_t f = around.corners[c] / 3;
+					normals_detail::weighted_face_normals( faces.data() + f, 0, 1, position, weighted );
+					n += weighted[ around.corners[c] % 3 ];
+				}
+				return n;
+			}, [&]( size_t i ) -> Vec3f& { return normal( dirty[i] ); } );
+		});
+	};
+	if( interleaved() ){
+		compute( [this]( size_t i ) -> const Vec3f& { return packed[i].position; }, [this]( size_t i ) -> Vec3f& { return packed[i].normal; } );
+	} else {
+		compute( [this]( size_t i ) -> const Vec3f& { return vertices[i]; }, [this]( size_t i ) -> Vec3f& { return normals[i]; } );
+	}
+
+	update.first = dirty.front();
+	update.end = size_t(dirty.back()) + 1;
+	update.count = dirty.size();
+	return update;
+}
+
+void TriMesh::need_colors()
+{
+	// Packed colors always hold the color, they just stop being all the same
+	if( interleaved() ){ packed_constant_color = false; return; }
 	if( vertices.size() == colors.size() ){ return; }
-	else{ colors.resize( vertices.size(), default_color ); }
+	else{ colors.resize( vertices.size(), constant_color ); }
 } // end need colors
 
-// Function to split a string into multiple strings, seperated by delimeter
-static void split_str( char delim, const std::string &str, std::vector<std::string> *result )
+bool TriMesh::compact_colors()
 {
-	std::stringstream ss(str); std::string s;
-	while( std::getline(ss, s, delim) ){ result->push_back(s); }
-}
+	if( interleaved() ){
+		if( packed_constant_color ){ return false; }
+		for( const Vertex &v : packed ){
+			if( std::memcmp( v.color.data, packed[0].color.data, sizeof(Vec3f) ) != 0 ){ return false; }
+		}
+		constant_color = packed[0].color;
+		packed_constant_color = true;
+		return true;
+	}
+	if( colors.empty() ){ return false; }
+	for( const Vec3f &c : colors ){
+		if( std::memcmp( c.data, colors[0].data, sizeof(Vec3f) ) != 0 ){ return false; }
+	}
+	constant_color = colors[0];
+	colors = std::vector<Vec3f>();
+	return true;
+} // end compact colors
+
+//
+//	OBJ parsing helpers
+//	The loader works on the raw bytes of a memory mapped file.
+//	Nothing in here allocates, all output goes into arrays that
+//	were sized up front by a counting pre-scan.
+//
+namespace obj_detail {
+
+// Number of records in (part of) an OBJ file
+struct Counts {
+	size_t verts = 0;
+	size_t normals = 0;
+	size_t corners = 0;
+	size_t triangles = 0;
+	size_t bare_corners = 0;	// corners without a normal
+
+	Counts& operator+=( const Counts &c )
+	{
+		verts += c.verts; normals += c.normals;
+		corners += c.corners; triangles += c.triangles;
+		bare_corners += c.bare_corners;
+		return *this;
+	}
+};
+
+// One face corner, as 0-based indices into the v/vn lists (n = -1 if none)
+struct Corner { int v, n; };
+
+// Where parse_records writes to
+struct Output {
+	Vec3f *verts;
+	Vec3f *colors;
+	Vec3f *normals;
+	Corner *corners;
+	Vec3i *faces;
+};
+
+enum class Record { none, vertex, normal, face };
+
+static inline bool is_space( char c ){ return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+static inline const char* skip_space( const char *p, const char *e ){ while( p < e && is_space(*p) ){ ++p; } return p; }
+
+static inline const char* skip_token( const char *p, const char *e ){ while( p < e && !is_space(*p) ){ ++p; } return p; }
 
-bool TriMesh::load_obj( std::string file )
+static inline const char* find_line_end( const char *p, const char *e )
 {
+	const void *nl = std::memchr( p, '\n', size_t(e - p) );
+	return nl ? static_cast<const char*>(nl) : e;
+}
 
-	std::cout << "\nLoading " << file << std::endl;
+// Faces may have a trailing comment
+static inline const char* strip_comment( const char *p, const char *e )
+{
+	const void *hash = std::memchr( p, '#', size_t(e - p) );
+	return hash ? static_cast<const char*>(hash) : e;
+}
 
-	//	README:
-	//
-	//	The problem with standard obj files and opengl is that
-	//	there isn't a good way to make triangles with different indices
-	//	for vertices/normals. At least, not any way that I'm aware of.
-	//	So for now, we'll do the inefficient (but robust) way:
-	//	redundant vertices/normals.
-	//
+// Figures out what a line holds, p is moved past the keyword
+static inline Record classify( const char *&p, const char *e )
+{
+	p = skip_space( p, e );
+	if( p == e ){ return Record::none; }
+	if( p[0] == 'v' ){
+		if( p+1 == e || is_space(p[1]) ){ p += 1; return Record::vertex; }
+		if( p[1] == 'n' && (p+2 == e || is_space(p[2])) ){ p += 2; return Record::normal; }
+	}
+	else if( p[0] == 'f' && (p+1 == e || is_space(p[1])) ){ p += 1; return Record::face; }
+	return Record::none;
+}
 
-	std::vector<Vec3f> temp_normals;
-	std::vector<Vec3f> temp_verts;
-	std::vector<Vec3f> temp_colors;
+// Returns the position after the number, or nullptr if there isn't one
+static inline const char* parse_float( const char *p, const char *e, float &value )
+{
+	p = skip_space( p, e );
+	if( p < e && *p == '+' ){ ++p; }
+	std::from_chars_result res = std::from_chars( p, e, value );
+	return res.ec == std::errc() ? res.ptr : nullptr;
+}
 
-	//
-	//	First loop, make buffers
-	//
-	std::ifstream infile( file.c_str() );
-	if( infile.is_open() ){
+static inline const char* parse_int( const char *p, const char *e, int &value )
+{
+	if( p < e && *p == '+' ){ ++p; }
+	std::from_chars_result res = std::from_chars( p, e, value );
+	return res.ec == std::errc() ? res.ptr : nullptr;
+}
 
-		std::string line;
-		while( std::getline( infile, line ) ){
+// OBJ indices are 1-based, negative ones count back from the last element seen
+static inline int resolve_index( int idx, size_t seen ){ return idx > 0 ? idx - 1 : int(seen) + idx; }
 
-			std::stringstream ss(line);
-			std::string tok; ss >> tok;
+// Parses one v, v/t, v/t/n or v//n face corner. vi and ni are the number of
+// vertices and normals seen so far. Returns nullptr if the corner is malformed.
+static inline const char* parse_corner( const char *p, const char *e, size_t vi, size_t ni, Corner &corner )
+{
+	int v = 0, n = 0;
+	if( !(p = parse_int(p, e, v)) || v == 0 ){ return nullptr; }
+	corner.v = resolve_index(v, vi);
+	corner.n = -1;
+	if( p < e && *p == '/' ){
+		++p;
+		while( p < e && *p != '/' && !is_space(*p) ){ ++p; } // skip texcoord
+		if( p < e && *p == '/' ){
+			++p;
+			if( !(p = parse_int(p, e, n)) || n == 0 ){ return nullptr; }
+			corner.n = resolve_index(n, ni);
+		}
+	}
+	if( p < e && !is_space(*p) ){ return nullptr; }
+	return p;
+}
 
-			// Vertex
-			if( tok == "v" ){
+// Counts the records in [begin,end), which must start at the beginning of a line
+static Counts count_records( const char *begin, const char *end )
+{
+	Counts c;
+	const char *p = begin;
+	while( p < end ){
+		const char *le = find_line_end( p, end );
+		const char *q = p;
+		switch( classify( q, le ) ){
+			case Record::vertex: ++c.verts; break;
+			case Record::normal: ++c.normals; break;
+			case Record::face: {
+				const char *fe = strip_comment( q, le );
+				size_t n = 0;
+				for( q = skip_space(q, fe); q < fe; q = skip_space(q, fe) ){
+					const char *te = skip_token( q, fe );
+					if( std::count( q, te, '/' ) < 2 ){ ++c.bare_corners; } // v, v/t
+					q = te;
+					++n;
+				}
+				c.corners += n;
+				if( n >= 3 ){ c.triangles += n - 2; }
+				break;
+			}
+			case Record::none: break;
+		}
+		p = le + 1;
+	}
+	return c;
+}
 
-				// First three location
-				float x, y, z; ss >> x >> y >> z;
-				temp_verts.push_back( Vec3f(x,y,z) );
+// Parses the records in [begin,end) into out. base holds the number of records
+// that come before begin in the file, so we know where to write and how to
+// resolve relative indices. Returns nullptr on success, or the bad line.
+static const char* parse_records( const char *begin, const char *end, Counts base, const Output &out )
+{
+	size_t vi = base.verts, ni = base.normals, ci = base.corners, ti = base.triangles;
+	const char *p = begin;
+	while( p < end ){
+		const char *le = find_line_end( p, end );
+		const char *q = p;
+		switch( classify( q, le ) ){
+
+			// Vertex, with an optional color
+			case Record::vertex: {
+				float x, y, z;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ return p; }
+				out.verts[vi] = Vec3f(x,y,z);
 
-				// Next three colors
 				float cx, cy, cz;
-				if( ss >> cx >> cy >> cz ){
-					temp_colors.push_back( Vec3f(cx,cy,cz) );
+				if( (q = parse_float(q, le, cx)) && (q = parse_float(q, le, cy)) && (q = parse_float(q, le, cz)) ){
+					out.colors[vi] = Vec3f(cx,cy,cz);
 				} else {
-					temp_colors.push_back( Vec3f(0.3f,0.3f,0.3f) );
+					out.colors[vi] = Vec3f(0.3f,0.3f,0.3f);
 				}
+				++vi;
+				break;
 			}
 
 			// Normal
-			if( tok == "vn" ){
-				float x, y, z; ss >> x >> y >> z;
-				temp_normals.push_back( Vec3f(x,y,z) );
+			case Record::normal: {
+				float x, y, z;
+				if( !(q = parse_float(q, le, x)) || !(q = parse_float(q, le, y)) || !(q = parse_float(q, le, z)) ){ return p; }
+				out.normals[ni++] = Vec3f(x,y,z);
+				break;
 			}
 
-		} // end loop lines
+			// Face, anything past a triangle is fanned around the first corner
+			case Record::face: {
+				const char *fe = strip_comment( q, le );
+				const size_t first = ci;
+				for( q = skip_space(q, fe); q < fe; q = skip_space(q, fe) ){
+					Corner corner;
+					if( !(q = parse_corner(q, fe, vi, ni, corner)) ){ return p; }
+					out.corners[ci] = corner;
+					if( ci - first >= 2 ){ out.faces[ti++] = Vec3i( int(first), int(ci-1), int(ci) ); }
+					++ci;
+				}
+				if( ci - first < 3 ){ return p; }
+				break;
+			}
 
-	} // end load obj
-	else { std::cerr << "\n**TriMesh::load_obj Error: Could not open file " << file << std::endl; return false; }
+			case Record::none: break;
+		}
+		p = le + 1;
+	}
+	return nullptr;
+}
 
-	//
-	//	Second loop, make faces
-	//
-	std::ifstream infile2( file.c_str() );
-	if( infile2.is_open() ){
+// Cuts [begin,end) into at most 'parts' chunks that start at the beginning of a line.
+// Chunks are kept above a minimum size, small files aren't worth splitting.
+static std::pmr::vector<const char*> split_lines( const char *begin, const char *end, size_t parts,
+	std::pmr::memory_resource *memory = std::pmr::get_default_resource() )
+{
+	const size_t min_chunk = size_t(1) << 20;
+	const size_t size = size_t(end - begin);
+	parts = std::max<size_t>( 1, std::min( parts, size / min_chunk ) );
+
+	std::pmr::vector<const char*> bounds( memory );
+	bounds.push_back( begin );
+	for( size_t k = 1; k < parts; ++k ){
+		const char *p = std::max( begin + size * k / parts, bounds.back() );
+		p = find_line_end( p, end );
+		if( p < end ){ ++p; }
+		if( p > bounds.back() && p < end ){ bounds.push_back( p ); }
+	}
+	bounds.push_back( end );
+	return bounds;
+}
 
-		std::string line;
-		while( std::getline( infile2, line ) ){
+// Open addressing hash map from a corner's (v,n) pair to the welded vertex that holds it
+class CornerMap {
+public:
+	explicit CornerMap( size_t expected, std::pmr::memory_resource *memory = std::pmr::get_default_resource() )
+		: keys( memory ), values( memory )
+	{
+		size_t capacity = 16;
+		while( capacity < expected * 2 ){ capacity <<= 1; }
+		keys.assign( capacity, empty_key );
+		values.resize( capacity );
+		mask = capacity - 1;
+	}
 
-			std::stringstream ss(line);
-			std::string tok; ss >> tok;
+	// Returns the vertex stored for the corner, or inserts next_vertex and returns that
+	uint32_t find_or_insert( const Corner &c, uint32_t next_vertex )
+	{
+		const uint64_t key = (uint64_t(uint32_t(c.v)) << 32) | uint32_t(c.n);
+		for( size_t slot = hash(key) & mask; ; slot = (slot + 1) & mask ){
+			if( keys[slot] == key ){ return values[slot]; }
+			if( keys[slot] == empty_key ){
+				keys[slot] = key;
+				values[slot] = next_vertex;
+				return next_vertex;
+			}
+		}
+	}
 
-			// Face
-			if( tok == "f" ){
+private:
+	// v is never negative, so this can't collide with a real corner
+	static constexpr uint64_t empty_key = ~uint64_t(0);
 
-				Vec3i face;
-				// Get the three vertices
-				for( size_t i=0; i<3; ++i ){
+	std::pmr::vector<uint64_t> keys;
+	std::pmr::vector<uint32_t> values;
+	size_t mask;
 
-					std::string f_str; ss >> f_str;
-					std::vector<std::string> f_vals;
-					split_str( '/', f_str, &f_vals );
-					assert(f_vals.size()>0);
+	static size_t hash( uint64_t k )
+	{
+		// Murmur3 finalizer
+		k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return size_t(k);
+	}
+};
 
-					face[i] = vertices.size();
-					int v_idx = std::stoi(f_vals[0])-1;
-					vertices.push_back( temp_verts[v_idx] );
-					colors.push_back( temp_colors[v_idx] );
+// Welds corners with the same (v,n) pair. remap takes every corner to its vertex,
+// source lists the first corner of every vertex. If use_normals is false
+// corners are welded by position only.
+static void weld_corners( const std::pmr::vector<Corner> &corners, bool use_normals, std::pmr::vector<uint32_t> &remap, std::pmr::vector<uint32_t> &source )
+{
+	const size_t nc = corners.size();
+	CornerMap map( nc, remap.get_allocator().resource() );
+	remap.resize( nc );
+	source.clear();
+	for( size_t i = 0; i < nc; ++i ){
+		Corner key = corners[i];
+		if( !use_normals ){ key.n = -1; }
+		const uint32_t vertex = map.find_or_insert( key, uint32_t(source.size()) );
+		if( vertex == source.size() ){ source.push_back( uint32_t(i) ); }
+		remap[i] = vertex;
+	}
+}
 
-					// Check for normal
-					if( f_vals.size()>2 ){
-						int n_idx = std::stoi(f_vals[2])-1;
-						normals.push_back( temp_normals[n_idx] );
-					}
-				}
+// Human readable line number of a position in the file, for error messages
+static size_t line_number( const char *begin, const char *pos )
+{
+	size_t line = 1;
+	for( const char *p = begin; p < pos; ++p ){ if( *p == '\n' ){ ++line; } }
+	return line;
+}
 
-				faces.push_back(face);
+} // end namespace obj_detail
 
-				// If it's a quad, make another triangle
-				std::string last_vert="";
-				if( ss >> last_vert ){
-					Vec3i face2;
-					face2[0] = face[0];
-					face2[1] = face[2];
+bool TriMesh::load_obj( std::string file, const ObjLoadOptions &options )
+{
 
-					std::vector<std::string> f_vals;
-					split_str( '/', last_vert, &f_vals );
-					assert(f_vals.size()>0);
+	std::cout << "\nLoading " << file << std::endl;
 
-					int v_idx = std::stoi(f_vals[0])-1;
-					vertices.push_back( temp_verts[v_idx] );
-					colors.push_back( temp_colors[v_idx] );
-					face2[2] = vertices.size();
+	//	README:
+	//
+	//	The problem with standard obj files and opengl is that
+	//	there isn't a good way to make triangles with different indices
+	//	for vertices/normals. At least, not any way that I'm aware of.
+	//	So by default we'll do the inefficient (but robust) way:
+	//	redundant vertices/normals. Set weld_vertices to share a vertex
+	//	between all corners that use the same position and normal.
+	//
+	//	The file is memory mapped and tokenized in place. It is cut into
+	//	newline aligned chunks, and a cheap counting pre-scan of each chunk
+	//	gives the number of records in it. A prefix sum over those counts
+	//	tells every chunk where its output starts, so the chunks are then
+	//	parsed in parallel straight into the final arrays. Faces are stored
+	//	as corners into the v/vn lists and resolved once everything is read,
+	//	so faces may reference vertices defined later (or in another chunk).
+	//
+	//	Every phase is timed into report, see LoadReport.
+	//
 
-					// Check for normal
-					if( f_vals.size()>2 ){
-						int n_idx = std::stoi(f_vals[2])-1;
-						normals.push_back( temp_normals[n_idx] );
-					}
+	report = LoadReport();
+	report.file = file;
+	report.source = "obj";
+	invalidate_adjacency();
+	report.threads = worker_count( options.threads );
+	const int64_t rss_before = peak_rss_bytes();
+	Stopwatch timer;
+
+	MappedFile mapped;
+	if( !mapped.open( file ) ){ std::cerr << "\n**TriMesh::load_obj Error: Could not open file " << file << std::endl; return false; }
+	report.bytes_read = mapped.size();
+	report.open_ms = timer.lap();
+
+	// Scratch memory, released back to where it started when we return (after every vector below is gone)
+	Arena own_arena( options.arena ? 0 : options.arena_block_size );
+	Arena &arena = options.arena ? *options.arena : own_arena;
+	struct ReleaseArena { Arena &a; Arena::Mark start; ~ReleaseArena(){ a.release_to( start ); } } release_arena{ arena, arena.mark() };
+	const size_t arena_blocks = arena.stats().heap_blocks, scratch_before = arena.stats().bytes_in_use;
+	arena.reset_peak();
+
+	const std::pmr::vector<const char*> bounds = obj_detail::split_lines( mapped.begin(), mapped.end(), worker_count(options.threads), &arena );
+	const size_t nchunks = bounds.size() - 1;
 
-					faces.push_back(face2);
-				}
+	//
+	//	Counting pre-scan, size the buffers
+	//
+	std::pmr::vector<obj_detail::Counts> bases( nchunks + 1, &arena );
+	parallel_tasks( nchunks, options.threads, [&]( size_t k ){
+		bases[k+1] = obj_detail::count_records( bounds[k], bounds[k+1] );
+	});
+	for( size_t k = 0; k < nchunks; ++k ){ bases[k+1] += bases[k]; }
+	const obj_detail::Counts &counts = bases[nchunks];
+
+	std::pmr::vector<Vec3f> temp_verts( counts.verts, &arena );
+	std::pmr::vector<Vec3f> temp_colors( counts.verts, &arena );
+	std::pmr::vector<Vec3f> temp_normals( counts.normals, &arena );
+	std::pmr::vector<obj_detail::Corner> corners( counts.corners, &arena );
+	std::pmr::vector<Vec3i> temp_faces( counts.triangles, &arena );
+	report.prescan_ms = timer.lap();
 
-			} // end parse face
+	//
+	//	Parse every chunk into its slice of the buffers
+	//
+	const obj_detail::Output out = { temp_verts.data(), temp_colors.data(), temp_normals.data(), corners.data(), temp_faces.data() };
+	std::pmr::vector<const char*> bad_lines( nchunks, nullptr, &arena );
+	parallel_tasks( nchunks, options.threads, [&]( size_t k ){
+		bad_lines[k] = obj_detail::parse_records( bounds[k], bounds[k+1], bases[k], out );
+	});
+	for( const char *bad : bad_lines ){
+		if( bad ){
+			std::cerr << "\n**TriMesh::load_obj Error: Malformed line " << obj_detail::line_number(mapped.begin(), bad) << " in " << file << std::endl;
+			return false;
+		}
+	}
+	report.parse_ms = timer.lap();
+
+	//
+	//	Resolve corners into vertices
+	//
+	const size_t nc = corners.size();
+	std::pmr::vector<char> range_ok( nchunks, 1, &arena ), range_normals( nchunks, 1, &arena );
+	parallel_tasks( nchunks, options.threads, [&]( size_t k ){
+		for( size_t i = nc * k / nchunks, end = nc * (k+1) / nchunks; i < end; ++i ){
+			const obj_detail::Corner &c = corners[i];
+			if( c.v < 0 || size_t(c.v) >= temp_verts.size() || c.n >= int(temp_normals.size()) ){ range_ok[k] = 0; }
+			if( c.n < 0 ){ range_normals[k] = 0; }
+		}
+	});
+	if( std::find( range_ok.begin(), range_ok.end(), 0 ) != range_ok.end() ){
+		std::cerr << "\n**TriMesh::load_obj Error: Face index out of range in " << file << std::endl;
+		return false;
+	}
+	const bool corner_normals = nc > 0 && std::find( range_normals.begin(), range_normals.end(), 0 ) == range_normals.end();
+	if( !corner_normals && !temp_normals.empty() ){
+		std::cout << "**Warning: not every face corner has a normal, ignoring the loaded ones." << std::endl;
+	}
 
-		} // end loop lines
+	//
+	//	Optionally weld corners that share a (position, normal) pair
+	//
+	std::pmr::vector<uint32_t> weld_remap( &arena ), weld_source( &arena );
+	if( options.weld_vertices ){
+		obj_detail::weld_corners( corners, corner_normals, weld_remap, weld_source );
+		std::cout << "Welded " << nc << " face corners into " << weld_source.size() << " vertices (dedup ratio "
+			<< (weld_source.empty() ? 1.0 : double(nc) / double(weld_source.size())) << ")" << std::endl;
+	}
+	const bool welded = options.weld_vertices;
+	const size_t nv = welded ? weld_source.size() : nc;
+
+	// Vertices without a color got the default, if they all ended up the same
+	// there's no need for a color per vertex
+	const Vec3f file_color = temp_colors.empty() ? Vec3f(0.3f,0.3f,0.3f) : temp_colors[0];
+	bool varying_colors = false;
+	for( const Vec3f &c : temp_colors ){
+		if( std::memcmp( c.data, file_color.data, sizeof(Vec3f) ) != 0 ){ varying_colors = true; break; }
+	}
 
-	} // end load obj
+	// Appending keeps the layout the mesh already has, unless asked to change it
+	if( options.interleave ){ interleave(); }
+	else { deinterleave(); }
+	const bool packing = options.interleave;
+
+	const size_t first_vertex = num_vertices();
+	const size_t first_face = faces.size();
+
+	// Appending a different color to a mesh with a constant one needs the array after all
+	const bool color_array = !packing && ( varying_colors || !colors.empty() ||
+		( first_vertex > 0 && std::memcmp( constant_color.data, file_color.data, sizeof(Vec3f) ) != 0 ) );
+	const size_t grown = packing ? size_t( packed.capacity() < first_vertex + nv ) + size_t( faces.capacity() < first_face + temp_faces.size() ) :
+		size_t( vertices.capacity() < first_vertex + nv ) + size_t( color_array && colors.capacity() < first_vertex + nv ) +
+		size_t( corner_normals && normals.capacity() < first_vertex + nv ) + size_t( faces.capacity() < first_face + temp_faces.size() );
+	if( packing ){
+		packed.resize( first_vertex + nv );
+
+		// The slots are filled either way, a constant color is only remembered
+		packed_constant_color = !varying_colors && ( first_vertex == 0 ||
+			( packed_constant_color && std::memcmp( constant_color.data, file_color.data, sizeof(Vec3f) ) == 0 ) );
+		if( packed_constant_color ){ constant_color = file_color; }
+	} else {
+		vertices.resize( first_vertex + nv );
+		if( color_array ){
+			colors.resize( first_vertex, constant_color );
+			colors.resize( first_vertex + nv );
+		} else {
+			constant_color = file_color;
+		}
+		if( corner_normals ){ normals.resize( first_vertex + nv ); }
+	}
+	faces.resize( first_face + temp_faces.size() );
+
+	parallel_tasks( nchunks, options.threads, [&]( size_t k ){
+		for( size_t i = nv * k / nchunks, end = nv * (k+1) / nchunks; i < end; ++i ){
+			const obj_detail::Corner &c = corners[ welded ? weld_source[i] : i ];
+			if( packing ){
+				Vertex &v = packed[first_vertex+i];
+				v.position = temp_verts[c.v];
+				v.color = temp_colors[c.v];
+				v.normal = corner_normals ? temp_normals[c.n] : Vec3f();
+				continue;
+			}
+			vertices[first_vertex+i] = temp_verts[c.v];
+			if( color_array ){ colors[first_vertex+i] = temp_colors[c.v]; }
+			if( corner_normals ){ normals[first_vertex+i] = temp_normals[c.n]; }
+		}
+		const size_t nf = temp_faces.size();
+		for( size_t i = nf * k / nchunks, end = nf * (k+1) / nchunks; i < end; ++i ){
+			Vec3i f = temp_faces[i];
+			for( int j = 0; j < 3; ++j ){
+				f[j] = int(first_vertex) + ( welded ? int(weld_remap[f[j]]) : f[j] );
+			}
+			faces[first_face+i] = f;
+		}
+	});
+	report.resolve_ms = timer.lap();
+	report.heap_allocations = arena.stats().heap_blocks - arena_blocks + grown;
+	report.scratch_peak_bytes = arena.stats().peak_bytes - scratch_before;
 
 	// Make sure we have normals
-	if( !normals.size() ){
+	if( packing ? !corner_normals : !normals.size() ){
 		std::cout << "**Warning: normals not loaded so we'll compute them instead." << std::endl;
-		need_normals();
+		need_normals( packing );
 	}
 
+	report.vertices = num_vertices();
+	report.faces = faces.size();
+	report.peak_rss_delta = peak_rss_bytes() - rss_before;
+
 	return true;
 
 } // end load obj